@@ -0,0 +1,112 @@
+#include "activity.h"
+#include <algorithm>
+
+ActivityMap::ActivityMap(int arg_width, int arg_height)
+{
+	width = arg_width;
+	height = arg_height;
+	tilesX = (arg_width + TILE - 1) / TILE;
+	tilesY = (arg_height + TILE - 1) / TILE;
+	densityThreshold = 1e-4f;
+	motionThreshold = 1e-4f;
+	coveredMotion = 0.0f;
+	active.assign(tilesX * tilesY, 1);
+	wasActive.assign(tilesX * tilesY, 1);
+	occupied.assign(tilesX * tilesY, 0);
+	spans.resize(tilesY);
+	rowBegin = 0;
+	rowEnd = arg_height;
+	enabled = false;
+	buildSpans();
+}
+
+void ActivityMap::setEnabled(bool arg_enabled)
+{
+	enabled = arg_enabled;
+	// start from everything active, the next update finds what is quiet and clears it
+	activateAll();
+}
+
+void ActivityMap::activateAll()
+{
+	std::fill(active.begin(), active.end(), 1);
+	buildSpans();
+}
+
+void ActivityMap::setRowWindow(int arg_begin, int arg_end)
+{
+	rowBegin = arg_begin;
+	rowEnd = arg_end;
+}
+
+void ActivityMap::beginUpdate()
+{
+	wasActive.swap(active);
+	std::fill(occupied.begin(), occupied.end(), 0);
+}
+
+void ActivityMap::finishUpdate(int arg_haloTiles)
+{
+	// one tile of the halo is kept for diffusion, the rest covers motion
+	coveredMotion = (float)((arg_haloTiles - 1) * TILE);
+	std::fill(active.begin(), active.end(), 0);
+	for (int ty = 0; ty < tilesY; ty++) {
+		for (int tx = 0; tx < tilesX; tx++) {
+			if (!occupied[tx + ty * tilesX])
+			{
+				continue;
+			}
+			int y0 = std::max(0, ty - arg_haloTiles), y1 = std::min(tilesY - 1, ty + arg_haloTiles);
+			int x0 = std::max(0, tx - arg_haloTiles), x1 = std::min(tilesX - 1, tx + arg_haloTiles);
+			for (int y = y0; y <= y1; y++) {
+				for (int x = x0; x <= x1; x++) {
+					active[x + y * tilesX] = 1;
+				}
+			}
+		}
+	}
+	buildSpans();
+}
+
+float ActivityMap::activeFraction() const
+{
+	if (!enabled)
+	{
+		return 1.0f;
+	}
+	int count = 0;
+	for (size_t i = 0; i < active.size(); i++)
+	{
+		count += active[i];
+	}
+	return (float)count / active.size();
+}
+
+void ActivityMap::buildSpans()
+{
+	for (int ty = 0; ty < tilesY; ty++) {
+		std::vector<CellSpan>& row = spans[ty];
+		row.clear();
+		for (int tx = 0; tx < tilesX; tx++) {
+			if (enabled && !active[tx + ty * tilesX])
+			{
+				continue;
+			}
+			// interior cells only, adjacent active tiles merge into one span
+			int begin = std::max(1, tx * TILE);
+			int end = std::min(width - 1, (tx + 1) * TILE);
+			if (begin >= end)
+			{
+				continue;
+			}
+			if (!row.empty() && row.back().end == begin)
+			{
+				row.back().end = end;
+			}
+			else
+			{
+				row.push_back(CellSpan(begin, end));
+			}
+		}
+	}
+}
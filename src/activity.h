@@ -0,0 +1,79 @@
+#pragma once
+#ifndef ACTIVITY_H
+#define ACTIVITY_H
+#include <vector>
+
+// A run of interior cells [begin, end) on one row that the kernels visit
+class CellSpan
+{
+public:
+	int begin, end;
+	CellSpan(int arg_begin, int arg_end) : begin(arg_begin), end(arg_end) {}
+};
+
+// Tracks which TILE x TILE tiles of the grid hold any fluid activity.
+// Inactive tiles are kept at exactly zero in every plane, so the kernels
+// can skip them and only visit the row spans of active tiles. Each step the
+// occupied tiles are dilated by a halo wide enough to cover the furthest
+// backtrace of that step plus one tile for diffusion.
+//
+// Tracking is an approximation, not an exact skip. The pressure solve is
+// global, and skipped tiles take part in it as p = 0, so results drift
+// slightly from a full sweep (about 1e-5 relative through advance()).
+// The halo is sized from the fastest cell at the start of a step. If a
+// projection leaves faster flow than coveredMotion, the simulator activates
+// every tile for the rest of that step, so an oversized step costs a full
+// sweep instead of outrunning the halo.
+//
+// When disabled every row is a single span covering the whole interior.
+// A row window, used by DecomposedSimulator, empties the spans of every row
+// outside it whether tracking is enabled or not.
+class ActivityMap
+{
+public:
+	static const int TILE = 16;
+
+	int width, height;
+	int tilesX, tilesY;
+	bool enabled;
+	// a tile is occupied if any density exceeds densityThreshold or any cell
+	// moves more than motionThreshold cells per step
+	float densityThreshold, motionThreshold;
+	// cells per step a backtrace may move and still find everything it
+	// needs inside the active set, as sized by the last update
+	float coveredMotion;
+	std::vector<unsigned char> active;
+	std::vector<unsigned char> wasActive;
+	std::vector<unsigned char> occupied;
+
+	ActivityMap(int arg_width, int arg_height);
+	void setEnabled(bool arg_enabled);
+	// moves the current activity to wasActive and clears the occupancy
+	void beginUpdate();
+	inline void markOccupied(int arg_x, int arg_y)
+	{
+		occupied[arg_x / TILE + (arg_y / TILE) * tilesX] = 1;
+	}
+	// dilates the occupied tiles by arg_haloTiles into the new active set
+	void finishUpdate(int arg_haloTiles);
+	// makes every tile active until the next update
+	void activateAll();
+	inline bool isActive(int arg_tileX, int arg_tileY) const { return active[arg_tileX + arg_tileY * tilesX] != 0; }
+	inline bool wasTileActive(int arg_tileX, int arg_tileY) const { return wasActive[arg_tileX + arg_tileY * tilesX] != 0; }
+	inline const std::vector<CellSpan>& rowSpans(int arg_y) const
+	{
+		return arg_y >= rowBegin && arg_y < rowEnd ? spans[arg_y / TILE] : noSpans;
+	}
+	// restricts the kernels to rows [arg_begin, arg_end)
+	void setRowWindow(int arg_begin, int arg_end);
+	// share of tiles the kernels currently visit, 1 when disabled
+	float activeFraction() const;
+
+private:
+	std::vector<std::vector<CellSpan>> spans;
+	std::vector<CellSpan> noSpans;
+	int rowBegin, rowEnd;
+	void buildSpans();
+};
+
+#endif
@@ -0,0 +1,352 @@
+#include "amr.h"
+#include <glm/glm.hpp>
+
+RefinedPatch::RefinedPatch(int arg_blockX, int arg_blockY, const AdaptiveConfig& arg_config, float arg_coarseCellSize)
+{
+	blockX = arg_blockX;
+	blockY = arg_blockY;
+	int fineSize = arg_config.blockSize * arg_config.refinement + 2;
+	float fineCellSize = arg_coarseCellSize / arg_config.refinement;
+	cell = new FluidCell<RowMajorLayout>(arg_config.diffusion, arg_config.viscocity, arg_config.dt,
+		fineSize, fineSize, fineCellSize, fineCellSize);
+	simulator = new PatchSimulator(cell, arg_config.iterations);
+}
+
+RefinedPatch::~RefinedPatch()
+{
+	delete simulator;
+	delete cell;
+}
+
+AdaptiveSimulator::AdaptiveSimulator(const AdaptiveConfig& arg_config)
+	: config(arg_config),
+	coarseCell(arg_config.diffusion, arg_config.viscocity, arg_config.dt, arg_config.width, arg_config.height),
+	coarseSimulator(&coarseCell, arg_config.iterations)
+{
+	blocksX = (config.width + config.blockSize - 1) / config.blockSize;
+	blocksY = (config.height + config.blockSize - 1) / config.blockSize;
+	blockPatch.assign(blocksX * blocksY, -1);
+	stepCount = 0;
+}
+
+AdaptiveSimulator::~AdaptiveSimulator()
+{
+	for (size_t i = 0; i < patches.size(); i++)
+	{
+		delete patches[i];
+	}
+}
+
+void AdaptiveSimulator::step()
+{
+	if (stepCount % config.regridInterval == 0)
+	{
+		regrid();
+	}
+	stepCount++;
+
+	// the coarse step decides how much dye crosses into or out of each block
+	std::vector<float> exchange(patches.size());
+	for (size_t i = 0; i < patches.size(); i++)
+	{
+		exchange[i] = -coarseDye(patches[i]);
+	}
+	coarseSimulator.step();
+	for (size_t i = 0; i < patches.size(); i++)
+	{
+		float target = patchDye(patches[i]) + exchange[i] + coarseDye(patches[i]);
+		prolong(patches[i], true);
+		patches[i]->simulator->step();
+		reflux(patches[i], target);
+		restrictToCoarse(patches[i]);
+	}
+}
+
+void AdaptiveSimulator::addDye(int arg_posX, int arg_posY, float arg_amount)
+{
+	int localX, localY;
+	RefinedPatch* patch = patchAt(arg_posX, arg_posY, localX, localY);
+	if (patch)
+	{
+		patch->simulator->addDye(localX, localY, arg_amount);
+	}
+	else
+	{
+		// spread over the coarse cell so its average matches a fine injection
+		int r = config.refinement;
+		coarseSimulator.addDye(arg_posX / r, arg_posY / r, arg_amount / (r * r));
+	}
+}
+
+void AdaptiveSimulator::addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY)
+{
+	int localX, localY;
+	RefinedPatch* patch = patchAt(arg_posX, arg_posY, localX, localY);
+	if (patch)
+	{
+		patch->simulator->addVelocity(localX, localY, arg_amountX, arg_amountY);
+	}
+	else
+	{
+		int r = config.refinement;
+		coarseSimulator.addVelocity(arg_posX / r, arg_posY / r, arg_amountX / (r * r), arg_amountY / (r * r));
+	}
+}
+
+void AdaptiveSimulator::readDensity(float* arg_out) const
+{
+	const float* coarseDensity = coarseCell.density.current;
+	float r = (float)config.refinement;
+	for (int y = 0; y < getOutputHeight(); y++) {
+		for (int x = 0; x < getOutputWidth(); x++) {
+			int localX, localY;
+			RefinedPatch* patch = patchAt(x, y, localX, localY);
+			if (patch)
+			{
+				*arg_out++ = patch->cell->density.current[patch->cell->layout.GenerateIndex(localX, localY)];
+			}
+			else
+			{
+				*arg_out++ = sampleCoarse(coarseDensity, (x + 0.5f) / r - 0.5f, (y + 0.5f) / r - 0.5f);
+			}
+		}
+	}
+}
+
+float AdaptiveSimulator::getRefinedFraction() const
+{
+	return (float)patches.size() / (blocksX * blocksY);
+}
+
+void AdaptiveSimulator::regrid()
+{
+	std::vector<RefinedPatch*> kept;
+	std::vector<int> newBlockPatch(blocksX * blocksY, -1);
+	for (int by = 0; by < blocksY; by++) {
+		for (int bx = 0; bx < blocksX; bx++) {
+			float indicator = refinementIndicator(bx, by);
+			int existing = blockPatch[bx + by * blocksX];
+			if (existing >= 0 && indicator >= 0.5f)
+			{
+				newBlockPatch[bx + by * blocksX] = (int)kept.size();
+				kept.push_back(patches[existing]);
+			}
+			else if (existing < 0 && indicator > 1.0f && (int)kept.size() < config.maxPatches)
+			{
+				RefinedPatch* patch = new RefinedPatch(bx, by, config, coarseCell.cellSizeX);
+				prolong(patch, false);
+				newBlockPatch[bx + by * blocksX] = (int)kept.size();
+				kept.push_back(patch);
+			}
+			else if (existing >= 0)
+			{
+				// the coarse cells already hold this patch's restricted values
+				delete patches[existing];
+			}
+		}
+	}
+	patches.swap(kept);
+	blockPatch.swap(newBlockPatch);
+}
+
+// Largest of vorticity and density gradient over the block, each relative to
+// its threshold, so 1 is the refinement limit
+float AdaptiveSimulator::refinementIndicator(int arg_blockX, int arg_blockY) const
+{
+	const RowMajorLayout& layout = coarseCell.layout;
+	const float* vx = coarseCell.velocityX.current;
+	const float* vy = coarseCell.velocityY.current;
+	const float* density = coarseCell.density.current;
+	float rotationScale = 0.5f * coarseCell.dt / coarseCell.cellSizeX;
+	float maxVorticity = 0.0f, maxGradient = 0.0f;
+
+	int xEnd = glm::min(config.width - 1, (arg_blockX + 1) * config.blockSize);
+	int yEnd = glm::min(config.height - 1, (arg_blockY + 1) * config.blockSize);
+	for (int j = glm::max(1, arg_blockY * config.blockSize); j < yEnd; j++) {
+		for (int i = glm::max(1, arg_blockX * config.blockSize); i < xEnd; i++) {
+			float curl = (vy[layout.GenerateIndex(i + 1, j)] - vy[layout.GenerateIndex(i - 1, j)])
+				- (vx[layout.GenerateIndex(i, j + 1)] - vx[layout.GenerateIndex(i, j - 1)]);
+			float gradX = density[layout.GenerateIndex(i + 1, j)] - density[layout.GenerateIndex(i - 1, j)];
+			float gradY = density[layout.GenerateIndex(i, j + 1)] - density[layout.GenerateIndex(i, j - 1)];
+			maxVorticity = glm::max(maxVorticity, glm::abs(curl) * rotationScale);
+			maxGradient = glm::max(maxGradient, 0.5f * glm::sqrt(gradX * gradX + gradY * gradY));
+		}
+	}
+	return glm::max(maxVorticity / config.vorticityThreshold, maxGradient / config.gradientThreshold);
+}
+
+// Bilinear interpolation from the coarse level into the patch, either the
+// whole patch (when it is created) or only its ghost ring. Values go into
+// both planes of every field so whichever plane a kernel writes next already
+// has the boundary in place.
+void AdaptiveSimulator::prolong(RefinedPatch* arg_patch, bool arg_ghostsOnly)
+{
+	FluidCell<RowMajorLayout>* fine = arg_patch->cell;
+	const int n = fine->width;
+	float r = (float)config.refinement;
+	float originX = (float)(arg_patch->blockX * config.blockSize);
+	float originY = (float)(arg_patch->blockY * config.blockSize);
+
+	for (int j = 0; j < n; j++) {
+		for (int i = 0; i < n; i++) {
+			bool ghost = i == 0 || j == 0 || i == n - 1 || j == n - 1;
+			if (arg_ghostsOnly && !ghost)
+			{
+				continue;
+			}
+			float x = originX + (i - 0.5f) / r - 0.5f;
+			float y = originY + (j - 0.5f) / r - 0.5f;
+			int index = fine->layout.GenerateIndex(i, j);
+			fine->velocityX.current[index] = fine->velocityX.previous[index] = sampleCoarse(coarseCell.velocityX.current, x, y);
+			fine->velocityY.current[index] = fine->velocityY.previous[index] = sampleCoarse(coarseCell.velocityY.current, x, y);
+			fine->density.current[index] = fine->density.previous[index] = sampleCoarse(coarseCell.density.current, x, y);
+			fine->pressure[index] = 0.0f;
+			fine->divergence[index] = 0.0f;
+		}
+	}
+	if (arg_ghostsOnly)
+	{
+		return;
+	}
+
+	// the interpolated dye does not average back to the coarse cell it came
+	// from, so each coarse cell's fine cells are shifted until it does
+	const int ri = config.refinement;
+	int coveredX = glm::min(config.blockSize, config.width - arg_patch->blockX * config.blockSize);
+	int coveredY = glm::min(config.blockSize, config.height - arg_patch->blockY * config.blockSize);
+	for (int cj = 0; cj < coveredY; cj++) {
+		for (int ci = 0; ci < coveredX; ci++) {
+			float sum = 0.0f;
+			for (int fj = 1 + cj * ri; fj < 1 + (cj + 1) * ri; fj++) {
+				for (int fi = 1 + ci * ri; fi < 1 + (ci + 1) * ri; fi++) {
+					sum += fine->density.current[fine->layout.GenerateIndex(fi, fj)];
+				}
+			}
+			int coarseIndex = coarseCell.layout.GenerateIndex(arg_patch->blockX * config.blockSize + ci, arg_patch->blockY * config.blockSize + cj);
+			float shift = coarseCell.density.current[coarseIndex] - sum / (ri * ri);
+			for (int fj = 1 + cj * ri; fj < 1 + (cj + 1) * ri; fj++) {
+				for (int fi = 1 + ci * ri; fi < 1 + (ci + 1) * ri; fi++) {
+					int index = fine->layout.GenerateIndex(fi, fj);
+					fine->density.current[index] = fine->density.previous[index] = fine->density.current[index] + shift;
+				}
+			}
+		}
+	}
+}
+
+// Each coarse cell under the patch becomes the average of its fine cells
+void AdaptiveSimulator::restrictToCoarse(RefinedPatch* arg_patch)
+{
+	FluidCell<RowMajorLayout>* fine = arg_patch->cell;
+	const int r = config.refinement;
+	const float weight = 1.0f / (r * r);
+	for (int cj = 0; cj < config.blockSize; cj++) {
+		int coarseY = arg_patch->blockY * config.blockSize + cj;
+		if (coarseY >= config.height)
+		{
+			break;
+		}
+		for (int ci = 0; ci < config.blockSize; ci++) {
+			int coarseX = arg_patch->blockX * config.blockSize + ci;
+			if (coarseX >= config.width)
+			{
+				break;
+			}
+			float sumX = 0.0f, sumY = 0.0f, sumDensity = 0.0f;
+			for (int fj = 1 + cj * r; fj < 1 + (cj + 1) * r; fj++) {
+				for (int fi = 1 + ci * r; fi < 1 + (ci + 1) * r; fi++) {
+					int index = fine->layout.GenerateIndex(fi, fj);
+					sumX += fine->velocityX.current[index];
+					sumY += fine->velocityY.current[index];
+					sumDensity += fine->density.current[index];
+				}
+			}
+			int coarseIndex = coarseCell.layout.GenerateIndex(coarseX, coarseY);
+			coarseCell.velocityX.current[coarseIndex] = sumX * weight;
+			coarseCell.velocityY.current[coarseIndex] = sumY * weight;
+			coarseCell.density.current[coarseIndex] = sumDensity * weight;
+		}
+	}
+}
+
+float AdaptiveSimulator::coarseDye(const RefinedPatch* arg_patch) const
+{
+	int xEnd = glm::min(config.width, (arg_patch->blockX + 1) * config.blockSize);
+	int yEnd = glm::min(config.height, (arg_patch->blockY + 1) * config.blockSize);
+	float sum = 0.0f;
+	for (int j = arg_patch->blockY * config.blockSize; j < yEnd; j++) {
+		for (int i = arg_patch->blockX * config.blockSize; i < xEnd; i++) {
+			sum += coarseCell.density.current[coarseCell.layout.GenerateIndex(i, j)];
+		}
+	}
+	return sum;
+}
+
+float AdaptiveSimulator::patchDye(const RefinedPatch* arg_patch) const
+{
+	const FluidCell<RowMajorLayout>* fine = arg_patch->cell;
+	const int r = config.refinement;
+	int xEnd = 1 + glm::min(config.blockSize, config.width - arg_patch->blockX * config.blockSize) * r;
+	int yEnd = 1 + glm::min(config.blockSize, config.height - arg_patch->blockY * config.blockSize) * r;
+	float sum = 0.0f;
+	for (int j = 1; j < yEnd; j++) {
+		for (int i = 1; i < xEnd; i++) {
+			sum += fine->density.current[fine->layout.GenerateIndex(i, j)];
+		}
+	}
+	return sum / (r * r);
+}
+
+// The patch and the coarse level each move dye across the patch edge, and
+// only one of them may count. The coarse step's exchange is kept: the patch's
+// own, arg_target less what it holds now, is undone on its outermost cells,
+// where the two disagree.
+void AdaptiveSimulator::reflux(RefinedPatch* arg_patch, float arg_target)
+{
+	FluidCell<RowMajorLayout>* fine = arg_patch->cell;
+	const int r = config.refinement;
+	int xEnd = 1 + glm::min(config.blockSize, config.width - arg_patch->blockX * config.blockSize) * r;
+	int yEnd = 1 + glm::min(config.blockSize, config.height - arg_patch->blockY * config.blockSize) * r;
+	int edgeCells = 2 * (xEnd - 1) + 2 * (yEnd - 1) - 4;
+	float correction = (arg_target - patchDye(arg_patch)) * (r * r) / edgeCells;
+	for (int j = 1; j < yEnd; j++) {
+		for (int i = 1; i < xEnd; i++) {
+			if (i == 1 || j == 1 || i == xEnd - 1 || j == yEnd - 1)
+			{
+				fine->density.current[fine->layout.GenerateIndex(i, j)] += correction;
+			}
+		}
+	}
+}
+
+float AdaptiveSimulator::sampleCoarse(const float* arg_field, float arg_x, float arg_y) const
+{
+	float x = glm::clamp(arg_x, 0.0f, (float)(config.width - 1));
+	float y = glm::clamp(arg_y, 0.0f, (float)(config.height - 1));
+	int i0 = (int)x, j0 = (int)y;
+	int i1 = glm::min(i0 + 1, config.width - 1);
+	int j1 = glm::min(j0 + 1, config.height - 1);
+	float s1 = x - i0, t1 = y - j0;
+	const RowMajorLayout& layout = coarseCell.layout;
+	return (1.0f - s1) * ((1.0f - t1) * arg_field[layout.GenerateIndex(i0, j0)] + t1 * arg_field[layout.GenerateIndex(i0, j1)])
+		+ s1 * ((1.0f - t1) * arg_field[layout.GenerateIndex(i1, j0)] + t1 * arg_field[layout.GenerateIndex(i1, j1)]);
+}
+
+RefinedPatch* AdaptiveSimulator::patchAt(int arg_fineX, int arg_fineY, int& arg_localX, int& arg_localY) const
+{
+	int blockFine = config.blockSize * config.refinement;
+	int bx = arg_fineX / blockFine;
+	int by = arg_fineY / blockFine;
+	if (bx < 0 || by < 0 || bx >= blocksX || by >= blocksY)
+	{
+		return nullptr;
+	}
+	int index = blockPatch[bx + by * blocksX];
+	if (index < 0)
+	{
+		return nullptr;
+	}
+	arg_localX = 1 + arg_fineX - bx * blockFine;
+	arg_localY = 1 + arg_fineY - by * blockFine;
+	return patches[index];
+}
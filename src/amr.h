@@ -0,0 +1,107 @@
+#pragma once
+#ifndef AMR_H
+#define AMR_H
+#include "simulator.h"
+#include <vector>
+
+class AdaptiveConfig
+{
+public:
+	// coarse grid, in coarse cells
+	int width, height;
+	// coarse cells along each side of a refinable block
+	int blockSize;
+	// fine cells per coarse cell along each axis
+	int refinement;
+	int iterations;
+	float diffusion, viscocity, dt;
+	// a block is refined when its vorticity (radians per step) or its density
+	// gradient (per coarse cell) exceeds these, and coarsened below half of them
+	float vorticityThreshold, gradientThreshold;
+	int regridInterval;
+	int maxPatches;
+	AdaptiveConfig()
+		: width(128), height(128), blockSize(16), refinement(4), iterations(16),
+		diffusion(0.2f), viscocity(0.01f), dt(0.000005f),
+		vorticityThreshold(0.05f), gradientThreshold(2.0f), regridInterval(4), maxPatches(64) {}
+};
+
+// both levels balance their stencils, the classic centre weights would drain
+// the patches, where a grows with refinement^2
+typedef FluidSimulator<GaussSeidelSolver, BilinearAdvector, BoxBoundary, RowMajorLayout, FloatPrecision, ConservativeStencil> CoarseSimulator;
+typedef FluidSimulator<GaussSeidelSolver, BilinearAdvector, FixedBoundary, RowMajorLayout, FloatPrecision, ConservativeStencil> PatchSimulator;
+
+// One refined block: a fine grid over blockSize^2 coarse cells plus a ghost ring
+class RefinedPatch
+{
+public:
+	int blockX, blockY;
+	FluidCell<RowMajorLayout>* cell;
+	PatchSimulator* simulator;
+	RefinedPatch(int arg_blockX, int arg_blockY, const AdaptiveConfig& arg_config, float arg_coarseCellSize);
+	RefinedPatch(const RefinedPatch&) = delete;
+	RefinedPatch& operator=(const RefinedPatch&) = delete;
+	~RefinedPatch();
+};
+
+// Two level block-structured refinement on top of the regular kernels. The
+// whole domain runs on a coarse FluidSimulator, and blocks with strong
+// vorticity or density gradients also run on a finer grid. Each step:
+//   - the coarse level steps
+//   - every patch has its ghost ring interpolated from the coarse level,
+//     which holds during the patch step as a fixed boundary
+//   - patches step with the same kernels at the finer spacing
+//   - each patch's dye is corrected to the amount the coarse step moved
+//     into or out of its block (refluxing)
+//   - patch cells are averaged back into the coarse cells they cover
+// Positions passed to addDye/addVelocity and the readDensity output use
+// fine resolution, width * refinement by height * refinement.
+//
+// Both levels solve with ConservativeStencil, so diffusion and the pressure
+// solve keep dye on either level. Shortcuts against full AMR:
+//   - refluxing corrects a patch's total dye, spread over its edge cells,
+//     not the flux through each coarse face; velocity is not refluxed
+//   - patches take the coarse dt, there is no subcycling in time
+//   - the pressure ghost ring of a patch is held at p = 0 (Dirichlet), not
+//     interpolated from the coarse pressure
+class AdaptiveSimulator
+{
+public:
+	AdaptiveConfig config;
+	FluidCell<RowMajorLayout> coarseCell;
+	CoarseSimulator coarseSimulator;
+
+	AdaptiveSimulator(const AdaptiveConfig& arg_config);
+	AdaptiveSimulator(const AdaptiveSimulator&) = delete;
+	AdaptiveSimulator& operator=(const AdaptiveSimulator&) = delete;
+	~AdaptiveSimulator();
+	void step();
+	void addDye(int arg_posX, int arg_posY, float arg_amount);
+	void addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY);
+	void readDensity(float* arg_out) const;
+	int getOutputWidth() const { return config.width * config.refinement; }
+	int getOutputHeight() const { return config.height * config.refinement; }
+	int getPatchCount() const { return (int)patches.size(); }
+	// share of the coarse grid covered by refined patches
+	float getRefinedFraction() const;
+
+private:
+	int blocksX, blocksY;
+	int stepCount;
+	std::vector<RefinedPatch*> patches;
+	// index into patches for every block, -1 where the block is not refined
+	std::vector<int> blockPatch;
+
+	void regrid();
+	float refinementIndicator(int arg_blockX, int arg_blockY) const;
+	void prolong(RefinedPatch* arg_patch, bool arg_ghostsOnly);
+	void restrictToCoarse(RefinedPatch* arg_patch);
+	// dye of the coarse cells under the patch, and of the patch itself in coarse units
+	float coarseDye(const RefinedPatch* arg_patch) const;
+	float patchDye(const RefinedPatch* arg_patch) const;
+	void reflux(RefinedPatch* arg_patch, float arg_target);
+	float sampleCoarse(const float* arg_field, float arg_x, float arg_y) const;
+	RefinedPatch* patchAt(int arg_fineX, int arg_fineY, int& arg_localX, int& arg_localY) const;
+};
+
+#endif
@@ -0,0 +1,370 @@
+#include "checkpoint.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+static const char CHECKPOINT_MAGIC[8] = { 'F', 'L', 'U', 'I', 'D', 'C', 'K', 0 };
+
+// Stable ids for the cell types a checkpoint may hold
+template <typename Layout> class LayoutKindOf;
+template <> class LayoutKindOf<RowMajorLayout> { public: static const uint32_t value = 0; };
+template <> class LayoutKindOf<TiledLayout<8>> { public: static const uint32_t value = 1; };
+template <> class LayoutKindOf<TiledLayout<16>> { public: static const uint32_t value = 2; };
+template <> class LayoutKindOf<MortonLayout> { public: static const uint32_t value = 3; };
+
+template <typename Precision> class PrecisionKindOf;
+template <> class PrecisionKindOf<FloatPrecision> { public: static const uint32_t value = 0; };
+template <> class PrecisionKindOf<DoublePrecision> { public: static const uint32_t value = 1; };
+template <> class PrecisionKindOf<HalfPrecision> { public: static const uint32_t value = 2; };
+template <> class PrecisionKindOf<BFloat16Precision> { public: static const uint32_t value = 3; };
+
+#ifdef _WIN32
+
+static bool WriteAll(HANDLE arg_file, const char* arg_data, uint64_t arg_bytes)
+{
+	while (arg_bytes > 0)
+	{
+		DWORD chunk = (DWORD)(arg_bytes < (1u << 30) ? arg_bytes : (1u << 30));
+		DWORD written = 0;
+		if (!WriteFile(arg_file, arg_data, chunk, &written, NULL) || written == 0)
+		{
+			return false;
+		}
+		arg_data += written;
+		arg_bytes -= written;
+	}
+	return true;
+}
+
+// Windows has no general gather write, so the two pieces go out back to back
+static bool WriteFileAtomically(const char* arg_path, const char* arg_temp, const char* arg_header, const char* arg_arena, uint64_t arg_arenaBytes)
+{
+	HANDLE file = CreateFileA(arg_temp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	bool written = WriteAll(file, arg_header, CHECKPOINT_ALIGNMENT) && WriteAll(file, arg_arena, arg_arenaBytes)
+		&& FlushFileBuffers(file);
+	CloseHandle(file);
+	return written && MoveFileExA(arg_temp, arg_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+}
+
+#else
+
+static bool WriteFileAtomically(const char* arg_path, const char* arg_temp, const char* arg_header, const char* arg_arena, uint64_t arg_arenaBytes)
+{
+	int file = open(arg_temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file < 0)
+	{
+		return false;
+	}
+	iovec pieces[2];
+	pieces[0].iov_base = (void*)arg_header;
+	pieces[0].iov_len = CHECKPOINT_ALIGNMENT;
+	pieces[1].iov_base = (void*)arg_arena;
+	pieces[1].iov_len = arg_arenaBytes;
+	// one call writes everything unless the kernel stops early, then carry on from there
+	int first = 0;
+	bool written = true;
+	while (first < 2)
+	{
+		ssize_t count = writev(file, pieces + first, 2 - first);
+		if (count < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (count <= 0)
+		{
+			written = false;
+			break;
+		}
+		while (first < 2 && (size_t)count >= pieces[first].iov_len)
+		{
+			count -= pieces[first].iov_len;
+			first++;
+		}
+		if (first < 2)
+		{
+			pieces[first].iov_base = (char*)pieces[first].iov_base + count;
+			pieces[first].iov_len -= count;
+		}
+	}
+	// on disk before the rename, or a crash could leave a renamed but empty file
+	written = written && fsync(file) == 0;
+	close(file);
+	return written && rename(arg_temp, arg_path) == 0;
+}
+
+#endif
+
+// Fills the padded header block for arg_cell, returns the arena size
+template <typename Layout, typename Precision>
+static uint64_t PrepareHeader(const FluidCell<Layout, Precision>& arg_cell, uint64_t arg_step, std::vector<char>& arg_block)
+{
+	typedef typename Precision::storage_type Storage;
+	const Storage* planes = arg_cell.getPlanes();
+	uint64_t arenaBytes = (uint64_t)FluidCell<Layout, Precision>::NUM_PLANES * arg_cell.layout.storageSize() * sizeof(Storage);
+
+	arg_block.assign(CHECKPOINT_ALIGNMENT, 0);
+	CheckpointHeader& header = *(CheckpointHeader*)arg_block.data();
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.headerSize = sizeof(CheckpointHeader);
+	header.width = arg_cell.width;
+	header.height = arg_cell.height;
+	header.cellSizeX = arg_cell.cellSizeX;
+	header.cellSizeY = arg_cell.cellSizeY;
+	header.diffusion = arg_cell.diffusion;
+	header.viscocity = arg_cell.viscocity;
+	header.dt = arg_cell.dt;
+	header.layoutKind = LayoutKindOf<Layout>::value;
+	header.precisionKind = PrecisionKindOf<Precision>::value;
+	header.storageBytes = sizeof(Storage);
+	header.step = arg_step;
+	header.arenaOffset = CHECKPOINT_ALIGNMENT;
+	header.arenaBytes = arenaBytes;
+	header.fieldCount = FIELD_COUNT;
+	const Storage* fields[FIELD_COUNT] = {
+		arg_cell.velocityX.current, arg_cell.velocityX.previous, arg_cell.velocityY.current, arg_cell.velocityY.previous,
+		arg_cell.density.current, arg_cell.density.previous, arg_cell.pressure, arg_cell.divergence
+	};
+	for (int i = 0; i < FIELD_COUNT; i++) {
+		header.fieldOffsets[i] = (uint64_t)(fields[i] - planes) * sizeof(Storage);
+	}
+	return arenaBytes;
+}
+
+template <typename Layout, typename Precision>
+bool WriteCheckpoint(const FluidCell<Layout, Precision>& arg_cell, const char* arg_path, uint64_t arg_step)
+{
+	std::vector<char> block;
+	uint64_t arenaBytes = PrepareHeader(arg_cell, arg_step, block);
+	std::string temp = std::string(arg_path) + ".tmp";
+	return WriteFileAtomically(arg_path, temp.c_str(), block.data(), (const char*)arg_cell.getPlanes(), arenaBytes);
+}
+
+#ifndef _WIN32
+
+ForkedCheckpoint::~ForkedCheckpoint()
+{
+	wait();
+}
+
+template <typename Layout, typename Precision>
+bool ForkedCheckpoint::start(const FluidCell<Layout, Precision>& arg_cell, const char* arg_path, uint64_t arg_step)
+{
+	if (poll() == CHECKPOINT_RUNNING)
+	{
+		return false;
+	}
+	// everything the child needs is built here: after fork() only this thread
+	// exists in the child, and a lock another thread held, such as the
+	// allocator's, would never be released
+	std::vector<char> block;
+	uint64_t arenaBytes = PrepareHeader(arg_cell, arg_step, block);
+	std::string temp = std::string(arg_path) + ".tmp";
+	const char* arena = (const char*)arg_cell.getPlanes();
+
+	std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		// the child sees the planes as they were at fork() however far the parent has moved on
+		bool written = WriteFileAtomically(arg_path, temp.c_str(), block.data(), arena, arenaBytes);
+		_exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	forkMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - before).count();
+	if (pid < 0)
+	{
+		status = CHECKPOINT_FAILED;
+		return false;
+	}
+	child = pid;
+	status = CHECKPOINT_RUNNING;
+	return true;
+}
+
+CheckpointStatus ForkedCheckpoint::poll()
+{
+	if (status == CHECKPOINT_RUNNING)
+	{
+		reap(WNOHANG);
+	}
+	return status;
+}
+
+CheckpointStatus ForkedCheckpoint::wait()
+{
+	while (status == CHECKPOINT_RUNNING)
+	{
+		reap(0);
+	}
+	return status;
+}
+
+void ForkedCheckpoint::reap(int arg_options)
+{
+	int exitStatus;
+	pid_t reaped = waitpid(child, &exitStatus, arg_options);
+	if (reaped == child)
+	{
+		status = WIFEXITED(exitStatus) && WEXITSTATUS(exitStatus) == EXIT_SUCCESS ? CHECKPOINT_DONE : CHECKPOINT_FAILED;
+		child = -1;
+	}
+	else if (reaped < 0 && errno != EINTR)
+	{
+		// someone else reaped it, e.g. a SIGCHLD handler set to SIG_IGN, so the outcome is unknown
+		status = CHECKPOINT_FAILED;
+		child = -1;
+	}
+}
+
+#define INSTANTIATE_FORKED_CHECKPOINT(LAYOUT, PRECISION) \
+	template bool ForkedCheckpoint::start<LAYOUT, PRECISION>(const FluidCell<LAYOUT, PRECISION>&, const char*, uint64_t);
+#else
+#define INSTANTIATE_FORKED_CHECKPOINT(LAYOUT, PRECISION)
+#endif
+
+template <typename Layout, typename Precision>
+MappedCheckpoint<Layout, Precision>* MappedCheckpoint<Layout, Precision>::Open(const char* arg_path)
+{
+	typedef typename Precision::storage_type Storage;
+	typedef typename Precision::compute_type Compute;
+	MappedCheckpoint* checkpoint = new MappedCheckpoint();
+	uint64_t fileBytes = 0;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(arg_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER size;
+	if (file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &size) && (uint64_t)size.QuadPart >= CHECKPOINT_ALIGNMENT)
+	{
+		fileBytes = size.QuadPart;
+		// copy-on-write view: the simulation may write, the file never changes
+		checkpoint->handle = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (checkpoint->handle)
+		{
+			checkpoint->mapping = MapViewOfFile(checkpoint->handle, FILE_MAP_COPY, 0, 0, 0);
+			checkpoint->mappingBytes = (size_t)fileBytes;
+		}
+	}
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file);
+	}
+#else
+	int file = open(arg_path, O_RDONLY);
+	struct stat status;
+	if (file >= 0 && fstat(file, &status) == 0 && (uint64_t)status.st_size >= CHECKPOINT_ALIGNMENT)
+	{
+		fileBytes = status.st_size;
+		// private mapping: the simulation may write, the file never changes
+		void* mapping = mmap(nullptr, (size_t)fileBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+		if (mapping != MAP_FAILED)
+		{
+			checkpoint->mapping = mapping;
+			checkpoint->mappingBytes = (size_t)fileBytes;
+		}
+	}
+	if (file >= 0)
+	{
+		close(file);
+	}
+#endif
+	if (!checkpoint->mapping)
+	{
+		delete checkpoint;
+		return nullptr;
+	}
+
+	CheckpointHeader& header = checkpoint->header;
+	memcpy(&header, checkpoint->mapping, sizeof(header));
+	bool valid = memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) == 0
+		&& header.version == CHECKPOINT_VERSION && header.headerSize == sizeof(CheckpointHeader)
+		&& header.layoutKind == LayoutKindOf<Layout>::value && header.precisionKind == PrecisionKindOf<Precision>::value
+		&& header.storageBytes == sizeof(Storage) && header.fieldCount == FIELD_COUNT
+		&& header.width > 2 && header.height > 2 && header.arenaOffset == CHECKPOINT_ALIGNMENT
+		&& header.arenaOffset + header.arenaBytes <= fileBytes;
+	if (valid)
+	{
+		// the arena must match what the layout would allocate for these dimensions
+		Layout layout(header.width, header.height, sizeof(Storage));
+		uint64_t planeBytes = (uint64_t)layout.storageSize() * sizeof(Storage);
+		valid = header.arenaBytes == Cell::NUM_PLANES * planeBytes;
+		for (int i = 0; valid && i < FIELD_COUNT; i++) {
+			valid = header.fieldOffsets[i] % planeBytes == 0 && header.fieldOffsets[i] + planeBytes <= header.arenaBytes;
+		}
+	}
+	if (!valid)
+	{
+		delete checkpoint;
+		return nullptr;
+	}
+
+	char* arena = (char*)checkpoint->mapping + header.arenaOffset;
+	Cell* cell = new Cell((float)header.diffusion, (float)header.viscocity, (float)header.dt, header.width, header.height,
+		(float)header.cellSizeX, (float)header.cellSizeY, (Storage*)arena);
+	// the constructor takes floats, a double cell gets its exact values back here
+	cell->cellSizeX = (Compute)header.cellSizeX;
+	cell->cellSizeY = (Compute)header.cellSizeY;
+	cell->diffusion = (Compute)header.diffusion;
+	cell->viscocity = (Compute)header.viscocity;
+	cell->dt = (Compute)header.dt;
+	Storage** fields[FIELD_COUNT] = {
+		&cell->velocityX.current, &cell->velocityX.previous, &cell->velocityY.current, &cell->velocityY.previous,
+		&cell->density.current, &cell->density.previous, &cell->pressure, &cell->divergence
+	};
+	for (int i = 0; i < FIELD_COUNT; i++) {
+		*fields[i] = (Storage*)(arena + header.fieldOffsets[i]);
+	}
+	checkpoint->cell = cell;
+	return checkpoint;
+}
+
+template <typename Layout, typename Precision>
+MappedCheckpoint<Layout, Precision>::~MappedCheckpoint()
+{
+	delete cell;
+#ifdef _WIN32
+	if (mapping)
+	{
+		UnmapViewOfFile(mapping);
+	}
+	if (handle)
+	{
+		CloseHandle(handle);
+	}
+#else
+	if (mapping)
+	{
+		munmap(mapping, mappingBytes);
+	}
+#endif
+}
+
+#define INSTANTIATE_CHECKPOINT(LAYOUT, PRECISION) \
+	template bool WriteCheckpoint<LAYOUT, PRECISION>(const FluidCell<LAYOUT, PRECISION>&, const char*, uint64_t); \
+	template class MappedCheckpoint<LAYOUT, PRECISION>; \
+	INSTANTIATE_FORKED_CHECKPOINT(LAYOUT, PRECISION)
+
+INSTANTIATE_CHECKPOINT(RowMajorLayout, FloatPrecision)
+INSTANTIATE_CHECKPOINT(TiledLayout<8>, FloatPrecision)
+INSTANTIATE_CHECKPOINT(TiledLayout<16>, FloatPrecision)
+INSTANTIATE_CHECKPOINT(MortonLayout, FloatPrecision)
+INSTANTIATE_CHECKPOINT(RowMajorLayout, DoublePrecision)
+INSTANTIATE_CHECKPOINT(RowMajorLayout, HalfPrecision)
+INSTANTIATE_CHECKPOINT(RowMajorLayout, BFloat16Precision)
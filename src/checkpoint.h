@@ -0,0 +1,114 @@
+#pragma once
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+#include "fluid.h"
+#include <cstdint>
+
+// On-disk snapshot of a FluidCell, little endian:
+//   CheckpointHeader, zero padded to CHECKPOINT_ALIGNMENT
+//   the cell's plane arena, byte for byte
+// The arena starts on a page boundary, so a mapped file can be handed to a
+// FluidCell as its planes without copying. The field table records where
+// each plane sits, since double buffering leaves current and previous in
+// either order.
+static const uint32_t CHECKPOINT_VERSION = 2;
+static const uint32_t CHECKPOINT_ALIGNMENT = 4096;
+
+// Plane order of the field table
+enum CheckpointField
+{
+	FIELD_VELOCITY_X, FIELD_VELOCITY_X_PREVIOUS, FIELD_VELOCITY_Y, FIELD_VELOCITY_Y_PREVIOUS,
+	FIELD_DENSITY, FIELD_DENSITY_PREVIOUS, FIELD_PRESSURE, FIELD_DIVERGENCE, FIELD_COUNT
+};
+
+class CheckpointHeader
+{
+public:
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	int32_t width, height;
+	// double, so a PRECISION_DOUBLE cell restarts with its exact parameters
+	double cellSizeX, cellSizeY;
+	double diffusion, viscocity, dt;
+	// identify the cell type, see CheckpointTraits in checkpoint.cpp
+	uint32_t layoutKind, precisionKind;
+	uint32_t storageBytes;
+	// the caller's step counter at the time of the snapshot
+	uint64_t step;
+	uint64_t arenaOffset, arenaBytes;
+	uint32_t fieldCount;
+	// byte offset of each plane from the start of the arena
+	uint64_t fieldOffsets[FIELD_COUNT];
+};
+
+// Writes the header and arena with one vectored write to a temporary file,
+// then renames it over arg_path, so a preempted write never replaces the
+// last good checkpoint. Returns false on any I/O error.
+template <typename Layout, typename Precision>
+bool WriteCheckpoint(const FluidCell<Layout, Precision>& arg_cell, const char* arg_path, uint64_t arg_step = 0);
+
+// A checkpoint mapped copy-on-write, with a FluidCell running directly on
+// the mapped arena. Loading copies nothing: pages are read in as the
+// simulation touches them, and only pages it writes are duplicated. The
+// file itself is never modified.
+template <typename Layout, typename Precision = FloatPrecision>
+class MappedCheckpoint
+{
+public:
+	typedef FluidCell<Layout, Precision> Cell;
+
+	CheckpointHeader header;
+	Cell* cell;
+
+	// returns nullptr if the file is missing, truncated, from another
+	// version or holds a different cell type
+	static MappedCheckpoint* Open(const char* arg_path);
+	MappedCheckpoint(const MappedCheckpoint&) = delete;
+	MappedCheckpoint& operator=(const MappedCheckpoint&) = delete;
+	~MappedCheckpoint();
+
+private:
+	void* mapping;
+	size_t mappingBytes;
+	// the file mapping object on Windows
+	void* handle;
+	MappedCheckpoint() : cell(nullptr), mapping(nullptr), mappingBytes(0), handle(nullptr) {}
+};
+
+#ifndef _WIN32
+#include <sys/types.h>
+
+enum CheckpointStatus { CHECKPOINT_IDLE, CHECKPOINT_RUNNING, CHECKPOINT_DONE, CHECKPOINT_FAILED };
+
+// Writes checkpoints from a forked child, so the caller only pauses for
+// fork() itself while the child writes the cell as it stood at that moment.
+// The pages are shared copy-on-write, so every page the parent writes
+// before the child finishes is duplicated: budget up to one more arena of
+// memory per checkpoint in flight. POSIX only, one checkpoint at a time.
+class ForkedCheckpoint
+{
+public:
+	ForkedCheckpoint() : child(-1), status(CHECKPOINT_IDLE), forkMs(0.0) {}
+	ForkedCheckpoint(const ForkedCheckpoint&) = delete;
+	ForkedCheckpoint& operator=(const ForkedCheckpoint&) = delete;
+	// waits for a checkpoint still being written
+	~ForkedCheckpoint();
+	// call between steps; false if a checkpoint is still running or fork() failed
+	template <typename Layout, typename Precision>
+	bool start(const FluidCell<Layout, Precision>& arg_cell, const char* arg_path, uint64_t arg_step = 0);
+	// reports whether the last checkpoint is still running, finished or failed, without blocking
+	CheckpointStatus poll();
+	CheckpointStatus wait();
+	// how long the last start() held up the caller, mostly copying page tables
+	double getForkMs() const { return forkMs; }
+
+private:
+	pid_t child;
+	CheckpointStatus status;
+	double forkMs;
+	void reap(int arg_options);
+};
+#endif
+
+#endif
@@ -27,4 +27,8 @@ extern void display(void);
 extern void keyboard(unsigned char key, int x, int y);
 extern void mouse(int button, int state, int x, int y);
 extern void mouseDrag(int x, int y);
-extern void reshape(int width, int height);
\ No newline at end of file
+extern void reshape(int width, int height);
+
+// set before init(): log the session's input to a file, or drive the viewer from one
+extern void recordInput(const char* path);
+extern void replayInput(const char* path);
\ No newline at end of file
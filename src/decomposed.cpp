@@ -0,0 +1,268 @@
+#include "decomposed.h"
+#include "simulator_impl.h"
+#include <algorithm>
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static void PinCurrentThread(int arg_index)
+{
+	unsigned int processors = std::max(1u, std::thread::hardware_concurrency());
+	int processor = arg_index % processors;
+#ifdef _WIN32
+	SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << processor);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(processor, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+// every slab needs at least haloRows rows for its neighbours to copy
+static DecomposedConfig Validated(const DecomposedConfig& arg_config)
+{
+	DecomposedConfig config = arg_config;
+	config.haloRows = std::max(1, config.haloRows);
+	config.threads = std::max(1, std::min(config.threads, (config.height - 2) / config.haloRows));
+	return config;
+}
+
+void SplitRows(int arg_height, int arg_count, int arg_index, int& arg_begin, int& arg_end)
+{
+	int interior = arg_height - 2;
+	arg_begin = 1;
+	for (int i = 0; i <= arg_index; i++) {
+		int rows = interior / arg_count + (i < interior % arg_count ? 1 : 0);
+		arg_end = arg_begin + rows;
+		if (i < arg_index)
+		{
+			arg_begin = arg_end;
+		}
+	}
+}
+
+void SpinBarrier::wait()
+{
+	int phase = generation.load(std::memory_order_acquire);
+	if (waiting.fetch_add(1, std::memory_order_acq_rel) + 1 == count)
+	{
+		waiting.store(0, std::memory_order_relaxed);
+		generation.fetch_add(1, std::memory_order_release);
+		return;
+	}
+	// spin briefly, then yield so an oversubscribed machine still makes progress
+	for (int spins = 0; generation.load(std::memory_order_acquire) == phase; spins++) {
+		if (spins > 1000)
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+SlabSimulator::SlabSimulator(Cell* arg_fluidCell, int arg_numIterations, HaloExchanger* arg_exchanger, int arg_index, int arg_count,
+	int arg_origin, int arg_ownedBegin, int arg_ownedEnd)
+	: FluidSimulator(arg_fluidCell, arg_numIterations)
+{
+	exchanger = arg_exchanger;
+	index = arg_index;
+	bottom = arg_index == 0;
+	top = arg_index == arg_count - 1;
+	origin = arg_origin;
+	ownedBegin = arg_ownedBegin;
+	ownedEnd = arg_ownedEnd;
+	published = nullptr;
+	ACTIVITY.setRowWindow(ownedBegin - origin, ownedEnd - origin);
+}
+
+// Walls first, so the rows the neighbours copy already carry their side columns
+void SlabSimulator::exchangeHalo(Storage* x, int arg_kind)
+{
+	const int w = GRID_WIDTH;
+	const int h = GRID_HEIGHT;
+	const float flipX = arg_kind == 1 ? -1.0f : 1.0f;
+	const float flipY = arg_kind == 2 ? -1.0f : 1.0f;
+
+	for (int j = ownedBegin - origin; j < ownedEnd - origin; j++) {
+		x[GenerateIndex(0, j)] = flipX * x[GenerateIndex(1, j)];
+		x[GenerateIndex(w - 1, j)] = flipX * x[GenerateIndex(w - 2, j)];
+	}
+	if (bottom)
+	{
+		for (int i = 1; i < w - 1; i++) {
+			x[GenerateIndex(i, 0)] = flipY * x[GenerateIndex(i, 1)];
+		}
+		x[GenerateIndex(0, 0)] = (x[GenerateIndex(1, 0)] + x[GenerateIndex(0, 1)]) * 0.5f;
+		x[GenerateIndex(w - 1, 0)] = (x[GenerateIndex(w - 2, 0)] + x[GenerateIndex(w - 1, 1)]) * 0.5f;
+	}
+	if (top)
+	{
+		for (int i = 1; i < w - 1; i++) {
+			x[GenerateIndex(i, h - 1)] = flipY * x[GenerateIndex(i, h - 2)];
+		}
+		x[GenerateIndex(0, h - 1)] = (x[GenerateIndex(1, h - 1)] + x[GenerateIndex(0, h - 2)]) * 0.5f;
+		x[GenerateIndex(w - 1, h - 1)] = (x[GenerateIndex(w - 2, h - 1)] + x[GenerateIndex(w - 1, h - 2)]) * 0.5f;
+	}
+
+	exchanger->exchangeRows(*this, x);
+}
+
+DecomposedSimulator::DecomposedSimulator(const DecomposedConfig& arg_config)
+	: config(Validated(arg_config)), barrier(config.threads), slabs(config.threads, nullptr), command(0), finished(0)
+{
+	for (int i = 0; i < config.threads; i++) {
+		int begin, end;
+		SplitRows(config.height, config.threads, i, begin, end);
+		workers.push_back(std::thread(&DecomposedSimulator::runWorker, this, i, begin, end));
+	}
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() { return finished == config.threads; });
+}
+
+DecomposedSimulator::~DecomposedSimulator()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		command = -1;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void DecomposedSimulator::runWorker(int arg_index, int arg_ownedBegin, int arg_ownedEnd)
+{
+	if (config.pinThreads)
+	{
+		PinCurrentThread(arg_index);
+	}
+	// a domain edge slab keeps the ghost row instead of a halo
+	int origin = arg_index == 0 ? 0 : arg_ownedBegin - config.haloRows;
+	int limit = arg_index == config.threads - 1 ? config.height : arg_ownedEnd + config.haloRows;
+	float cellSize = 1.0f / (std::max(config.width, config.height) - 2);
+	// allocated and zeroed on this thread, so the pages land on its node
+	SlabSimulator::Cell* cell = new SlabSimulator::Cell(config.diffusion, config.viscocity, config.dt,
+		config.width, limit - origin, cellSize, cellSize);
+	SlabSimulator* slab = new SlabSimulator(cell, config.iterations, this, arg_index, config.threads, origin, arg_ownedBegin, arg_ownedEnd);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		slabs[arg_index] = slab;
+		finished++;
+	}
+	done.notify_all();
+
+	int seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]() { return command != seen; });
+			seen = command;
+		}
+		if (seen < 0)
+		{
+			break;
+		}
+		slab->step();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished++;
+		}
+		done.notify_all();
+	}
+	delete slab;
+	delete cell;
+}
+
+// Between the barriers every slab only reads its neighbours' owned rows and
+// only writes its own halo rows, so the copies need no locking
+void DecomposedSimulator::exchangeRows(SlabSimulator& arg_slab, float* x)
+{
+	const int w = arg_slab.GRID_WIDTH;
+	const int h = arg_slab.GRID_HEIGHT;
+	arg_slab.published = x;
+	barrier.wait();
+	if (!arg_slab.bottom)
+	{
+		const SlabSimulator* below = slabs[arg_slab.index - 1];
+		for (int row = arg_slab.origin; row < arg_slab.ownedBegin; row++) {
+			memcpy(x + arg_slab.GenerateIndex(0, row - arg_slab.origin), below->published + below->GenerateIndex(0, row - below->origin), w * sizeof(float));
+		}
+	}
+	if (!arg_slab.top)
+	{
+		const SlabSimulator* above = slabs[arg_slab.index + 1];
+		for (int row = arg_slab.ownedEnd; row < arg_slab.origin + h; row++) {
+			memcpy(x + arg_slab.GenerateIndex(0, row - arg_slab.origin), above->published + above->GenerateIndex(0, row - above->origin), w * sizeof(float));
+		}
+	}
+	barrier.wait();
+}
+
+void DecomposedSimulator::step()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	command++;
+	finished = 0;
+	wake.notify_all();
+	done.wait(lock, [this]() { return finished == config.threads; });
+}
+
+// An injection also lands in any halo copy of the cell, so the first sweep
+// of the next step sees it on both sides of a slab edge
+void DecomposedSimulator::addDye(int arg_posX, int arg_posY, float arg_amount)
+{
+	for (SlabSimulator* slab : slabs) {
+		int row = arg_posY - slab->origin;
+		if (row >= 0 && row < slab->GRID_HEIGHT)
+		{
+			slab->addDye(arg_posX, row, arg_amount);
+		}
+	}
+}
+
+void DecomposedSimulator::addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY)
+{
+	for (SlabSimulator* slab : slabs) {
+		int row = arg_posY - slab->origin;
+		if (row >= 0 && row < slab->GRID_HEIGHT)
+		{
+			slab->addVelocity(arg_posX, row, arg_amountX, arg_amountY);
+		}
+	}
+}
+
+void DecomposedSimulator::readDensity(float* arg_out) const
+{
+	for (int j = 0; j < config.height; j++) {
+		// the edge slabs also hold the ghost rows
+		int s = 0;
+		while (s + 1 < (int)slabs.size() && j >= slabs[s]->ownedEnd) {
+			s++;
+		}
+		const SlabSimulator* slab = slabs[s];
+		const float* density = slab->FLUID_CELL->density.current;
+		for (int i = 0; i < config.width; i++) {
+			*arg_out++ = density[slab->GenerateIndex(i, j - slab->origin)];
+		}
+	}
+}
+
+float DecomposedSimulator::getMaxCellSpeed() const
+{
+	float speed = 0.0f;
+	for (const SlabSimulator* slab : slabs) {
+		speed = std::max(speed, slab->MAX_CELL_SPEED);
+	}
+	return speed;
+}
+
+// the slabs' FluidSimulator, kept here so simulator.cpp links on its own
+template class FluidSimulator<GaussSeidelSolver, BilinearAdvector, HaloBoundary, RowMajorLayout>;
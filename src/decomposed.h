@@ -0,0 +1,134 @@
+#pragma once
+#ifndef DECOMPOSED_H
+#define DECOMPOSED_H
+#include "simulator.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class DecomposedConfig
+{
+public:
+	int width, height;
+	int iterations;
+	float diffusion, viscocity, dt;
+	// one slab and one worker thread each
+	int threads;
+	// rows copied from each neighbour; a backtrace further than this is clamped,
+	// so keep the CFL number below it
+	int haloRows;
+	// pin worker i to logical processor i modulo the processor count
+	bool pinThreads;
+	DecomposedConfig()
+		: width(SIZE), height(SIZE), iterations(16), diffusion(0.2f), viscocity(0.01f), dt(0.000005f),
+		threads(4), haloRows(4), pinThreads(true) {}
+};
+
+// Spinning barrier for the halo exchanges, which come too often to sleep on
+class SpinBarrier
+{
+public:
+	SpinBarrier(int arg_count) : count(arg_count), waiting(0), generation(0) {}
+	void wait();
+private:
+	const int count;
+	std::atomic<int> waiting;
+	std::atomic<int> generation;
+};
+
+class SlabSimulator;
+
+// Boundary policy of a slab: box walls where the slab meets the domain edge,
+// halo rows from the neighbouring slabs everywhere else
+class HaloBoundary
+{
+public:
+	// defined below, once SlabSimulator is complete
+	template <int B, typename Sim>
+	static void apply(Sim& arg_sim, typename Sim::Storage* x);
+};
+
+// Fills a slab's halo rows from its neighbours, on other threads or other processes
+class HaloExchanger
+{
+public:
+	virtual ~HaloExchanger() {}
+	virtual void exchangeRows(SlabSimulator& arg_slab, float* x) = 0;
+};
+
+// splits the interior rows 1 .. height - 2 into arg_count bands, the remainder going to the first ones
+void SplitRows(int arg_height, int arg_count, int arg_index, int& arg_begin, int& arg_end);
+
+// One horizontal band of the grid. Its FluidCell holds the rows it owns plus
+// haloRows copies of each neighbour's edge rows (or the ghost row at a domain
+// edge), and the row window keeps every kernel on the owned rows. Since the
+// solver, projection and advection all finish with setBoundaries, the halos
+// are refreshed exactly between the phases that read them.
+class SlabSimulator : public FluidSimulator<GaussSeidelSolver, BilinearAdvector, HaloBoundary, RowMajorLayout>
+{
+public:
+	HaloExchanger* exchanger;
+	int index;
+	// global row of the cell's first row, and the global rows this slab updates
+	int origin, ownedBegin, ownedEnd;
+	// whether the slab holds the ghost row of the domain's bottom or top edge
+	bool bottom, top;
+	// the plane passed to the exchange in progress, read by the neighbours
+	Storage* published;
+
+	SlabSimulator(Cell* arg_fluidCell, int arg_numIterations, HaloExchanger* arg_exchanger, int arg_index, int arg_count,
+		int arg_origin, int arg_ownedBegin, int arg_ownedEnd);
+	// box walls at the domain edges, then the exchanger's halo rows
+	void exchangeHalo(Storage* x, int arg_kind);
+};
+
+template <int B, typename Sim>
+void HaloBoundary::apply(Sim& arg_sim, typename Sim::Storage* x)
+{
+	static_cast<SlabSimulator&>(arg_sim).exchangeHalo(x, B);
+}
+
+// Domain decomposition over persistent worker threads. The interior rows are
+// split into one slab per worker, and each worker keeps its slab for the
+// simulator's lifetime: it allocates the slab's planes itself, so their
+// pages are first touched, and placed, on its own NUMA node, and it runs the
+// whole step on them. Workers only meet at the halo exchanges, where each
+// copies haloRows rows from its neighbours between two barriers, instead of
+// joining after every loop as a fork-join kernel would.
+//
+// Within a slab the solver sweeps Gauss-Seidel; across slabs the halos are
+// one iteration old, so the solve converges a little slower with more slabs.
+class DecomposedSimulator : public HaloExchanger
+{
+public:
+	DecomposedConfig config;
+	SpinBarrier barrier;
+	std::vector<SlabSimulator*> slabs;
+
+	DecomposedSimulator(const DecomposedConfig& arg_config);
+	DecomposedSimulator(const DecomposedSimulator&) = delete;
+	DecomposedSimulator& operator=(const DecomposedSimulator&) = delete;
+	~DecomposedSimulator();
+	void step();
+	void addDye(int arg_posX, int arg_posY, float arg_amount);
+	void addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY);
+	// writes the density as width * height floats, row by row
+	void readDensity(float* arg_out) const;
+	// largest MAX_CELL_SPEED over the slabs
+	float getMaxCellSpeed() const;
+	void exchangeRows(SlabSimulator& arg_slab, float* x) override;
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	// bumped once per step; workers exit when it goes negative
+	int command;
+	int finished;
+
+	void runWorker(int arg_index, int arg_ownedBegin, int arg_ownedEnd);
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "distributed.h"
+#include <algorithm>
+#include <vector>
+
+DistributedSimulator* DistributedSimulator::Create(const DistributedConfig& arg_config, Transport* arg_transport)
+{
+	if (arg_config.haloRows < 1 || (arg_config.height - 2) / arg_transport->getSize() < arg_config.haloRows)
+	{
+		return nullptr;
+	}
+	return new DistributedSimulator(arg_config, arg_transport);
+}
+
+DistributedSimulator::DistributedSimulator(const DistributedConfig& arg_config, Transport* arg_transport)
+	: config(arg_config), transport(arg_transport)
+{
+	int rank = transport->getRank();
+	int size = transport->getSize();
+	int begin, end;
+	SplitRows(config.height, size, rank, begin, end);
+	int origin = rank == 0 ? 0 : begin - config.haloRows;
+	int limit = rank == size - 1 ? config.height : end + config.haloRows;
+	float cellSize = 1.0f / (std::max(config.width, config.height) - 2);
+	cell = new SlabSimulator::Cell(config.diffusion, config.viscocity, config.dt, config.width, limit - origin, cellSize, cellSize);
+	slab = new SlabSimulator(cell, config.iterations, this, rank, size, origin, begin, end);
+}
+
+DistributedSimulator::~DistributedSimulator()
+{
+	delete slab;
+	delete cell;
+}
+
+void DistributedSimulator::step()
+{
+	slab->step();
+}
+
+// A band of rows is contiguous in the row-major planes, so the owned edge
+// rows go out and the halo rows come in without packing
+void DistributedSimulator::exchangeRows(SlabSimulator& arg_slab, float* x)
+{
+	const int rank = transport->getRank();
+	const int halo = config.haloRows;
+	size_t bytes = (arg_slab.GenerateIndex(0, halo) - arg_slab.GenerateIndex(0, 0)) * sizeof(float);
+	for (int pass = 0; pass < 2; pass++) {
+		// even ranks pair upwards first and odd ranks downwards, so both ends of each link meet
+		bool upwards = (pass == 0) == (rank % 2 == 0);
+		if (upwards && !arg_slab.top)
+		{
+			transport->exchange(rank + 1,
+				x + arg_slab.GenerateIndex(0, arg_slab.ownedEnd - halo - arg_slab.origin),
+				x + arg_slab.GenerateIndex(0, arg_slab.ownedEnd - arg_slab.origin), bytes);
+		}
+		if (!upwards && !arg_slab.bottom)
+		{
+			transport->exchange(rank - 1,
+				x + arg_slab.GenerateIndex(0, arg_slab.ownedBegin - arg_slab.origin),
+				x + arg_slab.GenerateIndex(0, 0), bytes);
+		}
+	}
+}
+
+void DistributedSimulator::addDye(int arg_posX, int arg_posY, float arg_amount)
+{
+	int row = arg_posY - slab->origin;
+	if (row >= 0 && row < slab->GRID_HEIGHT)
+	{
+		slab->addDye(arg_posX, row, arg_amount);
+	}
+}
+
+void DistributedSimulator::addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY)
+{
+	int row = arg_posY - slab->origin;
+	if (row >= 0 && row < slab->GRID_HEIGHT)
+	{
+		slab->addVelocity(arg_posX, row, arg_amountX, arg_amountY);
+	}
+}
+
+// Each rank receives every row above its band from the rank above, puts its
+// own rows in front and passes the lot down, so rank 0 ends with the grid
+void DistributedSimulator::gatherDensity(float* arg_out)
+{
+	const int w = config.width;
+	int first = slab->bottom ? 0 : slab->ownedBegin;
+	int last = slab->top ? config.height : slab->ownedEnd;
+	std::vector<float> rows((config.height - first) * w);
+	const float* density = cell->density.current;
+	for (int j = first; j < last; j++) {
+		for (int i = 0; i < w; i++) {
+			rows[(j - first) * w + i] = density[slab->GenerateIndex(i, j - slab->origin)];
+		}
+	}
+	int rank = transport->getRank();
+	if (!slab->top)
+	{
+		transport->receive(rank + 1, rows.data() + (last - first) * w, (config.height - last) * w * sizeof(float));
+	}
+	if (slab->bottom)
+	{
+		std::copy(rows.begin(), rows.end(), arg_out);
+	}
+	else
+	{
+		transport->send(rank - 1, rows.data(), rows.size() * sizeof(float));
+	}
+}
+
+float DistributedSimulator::getMaxCellSpeed()
+{
+	return transport->allReduceMax(slab->MAX_CELL_SPEED);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+#include "decomposed.h"
+#include "transport.h"
+
+class DistributedConfig
+{
+public:
+	// the whole grid, the same on every rank
+	int width, height;
+	int iterations;
+	float diffusion, viscocity, dt;
+	// rows swapped with each neighbouring rank, see DecomposedConfig::haloRows
+	int haloRows;
+	DistributedConfig()
+		: width(SIZE), height(SIZE), iterations(16), diffusion(0.2f), viscocity(0.01f), dt(0.000005f), haloRows(4) {}
+};
+
+// One rank of a simulation split across processes. Rank r of n owns band r
+// of the rows, split as DecomposedSimulator splits them across threads, and
+// runs the same SlabSimulator on it; only the halo exchange differs, going
+// through the Transport to the ranks above and below. The pressure solve is
+// distributed the same way as every other solve, with the halos swapped
+// after each iteration.
+//
+// Every rank must make the same sequence of calls, since step(),
+// gatherDensity() and getMaxCellSpeed() all communicate. Positions are
+// global; an injection outside a rank's rows is ignored by that rank.
+// If a neighbour is lost the calls still return, with zeros in place of
+// the missing rows, and hasFailed() reports it; the results are then void.
+class DistributedSimulator : public HaloExchanger
+{
+public:
+	DistributedConfig config;
+	Transport* transport;
+	SlabSimulator::Cell* cell;
+	SlabSimulator* slab;
+
+	// returns nullptr if a band would be thinner than haloRows
+	static DistributedSimulator* Create(const DistributedConfig& arg_config, Transport* arg_transport);
+	DistributedSimulator(const DistributedSimulator&) = delete;
+	DistributedSimulator& operator=(const DistributedSimulator&) = delete;
+	~DistributedSimulator();
+	void step();
+	void addDye(int arg_posX, int arg_posY, float arg_amount);
+	void addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY);
+	// collects the whole density field on rank 0, row by row; arg_out is
+	// only written there and may be null on the other ranks
+	void gatherDensity(float* arg_out);
+	// largest MAX_CELL_SPEED over all ranks
+	float getMaxCellSpeed();
+	bool hasFailed() const { return transport->hasFailed(); }
+	void exchangeRows(SlabSimulator& arg_slab, float* x) override;
+
+private:
+	DistributedSimulator(const DistributedConfig& arg_config, Transport* arg_transport);
+};
+
+#endif
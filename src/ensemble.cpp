@@ -0,0 +1,264 @@
+#include "ensemble.h"
+#include "policies.h"
+#include <xmmintrin.h>
+#include <cmath>
+
+static const int NUM_PLANES = 8;
+
+template <int K>
+EnsembleSimulator<K>::EnsembleSimulator(int arg_width, int arg_height, int arg_numIterations, float arg_dt,
+	float arg_cellSizeX, float arg_cellSizeY)
+{
+	GRID_WIDTH = arg_width;
+	GRID_HEIGHT = arg_height;
+	NUM_ITERATIONS = arg_numIterations;
+	float defaultCellSize = 1.0f / ((arg_width > arg_height ? arg_width : arg_height) - 2);
+	cellSizeX = arg_cellSizeX > 0.0f ? arg_cellSizeX : defaultCellSize;
+	cellSizeY = arg_cellSizeY > 0.0f ? arg_cellSizeY : defaultCellSize;
+	dt = arg_dt;
+	for (int l = 0; l < K; l++) {
+		diffusion[l] = 0.0f;
+		viscocity[l] = 0.0f;
+	}
+
+	// one allocation for all planes, aligned so every cell's lanes share a cache line
+	int planeSize = arg_width * arg_height * K;
+	planes = (float*)_mm_malloc(sizeof(float) * NUM_PLANES * planeSize, 64);
+	for (int i = 0; i < NUM_PLANES * planeSize; i++)
+	{
+		planes[i] = 0.0f;
+	}
+	velocityX.current = planes;
+	velocityX.previous = planes + planeSize;
+	velocityY.current = planes + 2 * planeSize;
+	velocityY.previous = planes + 3 * planeSize;
+	density.current = planes + 4 * planeSize;
+	density.previous = planes + 5 * planeSize;
+	pressure = planes + 6 * planeSize;
+	divergence = planes + 7 * planeSize;
+}
+
+template <int K>
+EnsembleSimulator<K>::~EnsembleSimulator()
+{
+	_mm_free(planes);
+}
+
+template <int K>
+void EnsembleSimulator<K>::setParameters(int arg_lane, float arg_diffusion, float arg_viscocity)
+{
+	diffusion[arg_lane] = arg_diffusion;
+	viscocity[arg_lane] = arg_viscocity;
+}
+
+template <int K>
+void EnsembleSimulator<K>::addDye(int arg_lane, int arg_posX, int arg_posY, float arg_amount)
+{
+	density.current[GenerateIndex(arg_posX, arg_posY) + arg_lane] += arg_amount;
+}
+
+template <int K>
+void EnsembleSimulator<K>::addVelocity(int arg_lane, int arg_posX, int arg_posY, float arg_amountX, float arg_amountY)
+{
+	int index = GenerateIndex(arg_posX, arg_posY) + arg_lane;
+	velocityX.current[index] += arg_amountX;
+	velocityY.current[index] += arg_amountY;
+}
+
+template <int K>
+void EnsembleSimulator<K>::readDensity(int arg_lane, float* arg_out) const
+{
+	for (int j = 0; j < GRID_HEIGHT; j++) {
+		for (int i = 0; i < GRID_WIDTH; i++) {
+			*arg_out++ = density.current[GenerateIndex(i, j) + arg_lane];
+		}
+	}
+}
+
+template <int K>
+template <int B>
+void EnsembleSimulator<K>::diffuse(float* x, const float* x0, const float* arg_diff)
+{
+	float ax[K], ay[K], cInverse[K];
+	for (int l = 0; l < K; l++) {
+		ax[l] = dt * arg_diff[l] / (cellSizeX * cellSizeX);
+		ay[l] = dt * arg_diff[l] / (cellSizeY * cellSizeY);
+		cInverse[l] = 1.0f / ClassicStencil::diffusionCentre(ax[l], ay[l]);
+	}
+	linearSolve<B>(x, x0, ax, ay, cInverse);
+}
+
+// Row-ordered Gauss-Seidel like GaussSeidelSolver; the sweep order carries a
+// dependency from cell to cell, but never from lane to lane
+template <int K>
+template <int B>
+void EnsembleSimulator<K>::linearSolve(float* x, const float* x0, const float* ax, const float* ay, const float* cInverse)
+{
+	const int rowStride = GRID_WIDTH * K;
+	for (int k = 0; k < NUM_ITERATIONS; k++) {
+		for (int j = 1; j < GRID_HEIGHT - 1; j++) {
+			for (int i = 1; i < GRID_WIDTH - 1; i++) {
+				float* cell = x + GenerateIndex(i, j);
+				const float* source = x0 + GenerateIndex(i, j);
+				for (int l = 0; l < K; l++) {
+					cell[l] = (source[l]
+						+ ax[l] * (cell[l + K] + cell[l - K])
+						+ ay[l] * (cell[l + rowStride] + cell[l - rowStride])
+						) * cInverse[l];
+				}
+			}
+		}
+		setBoundaries<B>(x);
+	}
+}
+
+template <int K>
+void EnsembleSimulator<K>::project(float* arg_veloX, float* arg_veloY, float* p, float* div)
+{
+	const int rowStride = GRID_WIDTH * K;
+	float wx = 1.0f / (cellSizeX * cellSizeX);
+	float wy = 1.0f / (cellSizeY * cellSizeY);
+	float divScale = -2.0f / (wx + wy);
+	float halfInvHx = 0.5f / cellSizeX;
+	float halfInvHy = 0.5f / cellSizeY;
+	float ax[K], ay[K], cInverse[K];
+	for (int l = 0; l < K; l++) {
+		ax[l] = 2.0f * wx / (wx + wy);
+		ay[l] = 2.0f * wy / (wx + wy);
+		cInverse[l] = 1.0f / ClassicStencil::pressureCentre(ax[l], ay[l]);
+	}
+
+	for (int j = 1; j < GRID_HEIGHT - 1; j++) {
+		for (int i = 1; i < GRID_WIDTH - 1; i++) {
+			int index = GenerateIndex(i, j);
+			for (int l = 0; l < K; l++) {
+				div[index + l] = divScale * (
+					(arg_veloX[index + l + K] - arg_veloX[index + l - K]) * halfInvHx
+					+ (arg_veloY[index + l + rowStride] - arg_veloY[index + l - rowStride]) * halfInvHy);
+				p[index + l] = 0.0f;
+			}
+		}
+	}
+	setBoundaries<0>(div);
+	setBoundaries<0>(p);
+	linearSolve<0>(p, div, ax, ay, cInverse);
+
+	for (int j = 1; j < GRID_HEIGHT - 1; j++) {
+		for (int i = 1; i < GRID_WIDTH - 1; i++) {
+			int index = GenerateIndex(i, j);
+			for (int l = 0; l < K; l++) {
+				arg_veloX[index + l] -= (p[index + l + K] - p[index + l - K]) * halfInvHx;
+				arg_veloY[index + l] -= (p[index + l + rowStride] - p[index + l - rowStride]) * halfInvHy;
+			}
+		}
+	}
+	setBoundaries<1>(arg_veloX);
+	setBoundaries<2>(arg_veloY);
+}
+
+// Each lane backtraces on its own, so the four taps are gathers; the weights
+// and the blend still run across all lanes at once
+template <int K>
+template <int B>
+void EnsembleSimulator<K>::advect(float* d, const float* d0, const float* arg_veloX, const float* arg_veloY)
+{
+	float dtx = dt / cellSizeX;
+	float dty = dt / cellSizeY;
+	float maxX = GRID_WIDTH - 1.5f;
+	float maxY = GRID_HEIGHT - 1.5f;
+
+	for (int j = 1; j < GRID_HEIGHT - 1; j++) {
+		for (int i = 1; i < GRID_WIDTH - 1; i++) {
+			int index = GenerateIndex(i, j);
+			for (int l = 0; l < K; l++) {
+				float x = i - dtx * arg_veloX[index + l];
+				float y = j - dty * arg_veloY[index + l];
+				if (x < 0.5f) x = 0.5f;
+				if (x > maxX) x = maxX;
+				if (y < 0.5f) y = 0.5f;
+				if (y > maxY) y = maxY;
+				float i0 = std::floor(x);
+				float j0 = std::floor(y);
+				float s1 = x - i0;
+				float s0 = 1.0f - s1;
+				float t1 = y - j0;
+				float t0 = 1.0f - t1;
+				int tap = GenerateIndex((int)i0, (int)j0) + l;
+				int rowStride = GRID_WIDTH * K;
+				d[index + l] =
+					s0 * (t0 * d0[tap] + t1 * d0[tap + rowStride]) +
+					s1 * (t0 * d0[tap + K] + t1 * d0[tap + K + rowStride]);
+			}
+		}
+	}
+	setBoundaries<B>(d);
+}
+
+// closed box, as BoxBoundary
+template <int K>
+template <int B>
+void EnsembleSimulator<K>::setBoundaries(float* x)
+{
+	const int w = GRID_WIDTH;
+	const int h = GRID_HEIGHT;
+	const float flipY = B == 2 ? -1.0f : 1.0f;
+	const float flipX = B == 1 ? -1.0f : 1.0f;
+	for (int i = 1; i < w - 1; i++) {
+		float* bottom = x + GenerateIndex(i, 0);
+		float* top = x + GenerateIndex(i, h - 1);
+		for (int l = 0; l < K; l++) {
+			bottom[l] = flipY * bottom[l + w * K];
+			top[l] = flipY * top[l - w * K];
+		}
+	}
+
+	for (int j = 1; j < h - 1; j++) {
+		float* left = x + GenerateIndex(0, j);
+		float* right = x + GenerateIndex(w - 1, j);
+		for (int l = 0; l < K; l++) {
+			left[l] = flipX * left[l + K];
+			right[l] = flipX * right[l - K];
+		}
+	}
+
+	float* c00 = x + GenerateIndex(0, 0);
+	float* c01 = x + GenerateIndex(0, h - 1);
+	float* c10 = x + GenerateIndex(w - 1, 0);
+	float* c11 = x + GenerateIndex(w - 1, h - 1);
+	for (int l = 0; l < K; l++) {
+		c00[l] = (c00[l + K] + c00[l + w * K]) * 0.5f;
+		c01[l] = (c01[l + K] + c01[l - w * K]) * 0.5f;
+		c10[l] = (c10[l - K] + c10[l + w * K]) * 0.5f;
+		c11[l] = (c11[l - K] + c11[l - w * K]) * 0.5f;
+	}
+}
+
+template <int K>
+void EnsembleSimulator<K>::step()
+{
+	FluidField<float>& vx = velocityX;
+	FluidField<float>& vy = velocityY;
+
+	diffuse<1>(vx.previous, vx.current, viscocity);
+	diffuse<2>(vy.previous, vy.current, viscocity);
+	vx.swap();
+	vy.swap();
+
+	project(vx.current, vy.current, pressure, divergence);
+
+	advect<1>(vx.previous, vx.current, vx.current, vy.current);
+	advect<2>(vy.previous, vy.current, vx.current, vy.current);
+	vx.swap();
+	vy.swap();
+
+	project(vx.current, vy.current, pressure, divergence);
+
+	diffuse<0>(density.previous, density.current, diffusion);
+	density.swap();
+	advect<0>(density.previous, density.current, vx.current, vy.current);
+	density.swap();
+}
+
+// 8 lanes fill an AVX register of floats, 16 an AVX-512 one or two AVX ones
+template class EnsembleSimulator<8>;
+template class EnsembleSimulator<16>;
@@ -0,0 +1,783 @@
+#include "field_stream.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+static const char STREAM_MAGIC[8] = { 'F', 'L', 'U', 'I', 'D', 'S', 'T', 0 };
+static const uint32_t STREAM_VERSION = 1;
+static const uint32_t FRAME_TAG = 0x4D415246; // "FRAM"
+static const char INDEX_TAG[4] = { 'F', 'I', 'D', 'X' };
+
+// How a channel's residual planes are stored
+enum StreamMethod { METHOD_RAW, METHOD_LZ, METHOD_RANS };
+
+static bool SeekTo(FILE* arg_file, uint64_t arg_offset)
+{
+#ifdef _WIN32
+	return _fseeki64(arg_file, (__int64)arg_offset, SEEK_SET) == 0;
+#else
+	return fseeko(arg_file, (off_t)arg_offset, SEEK_SET) == 0;
+#endif
+}
+
+static uint64_t FileSize(FILE* arg_file)
+{
+#ifdef _WIN32
+	_fseeki64(arg_file, 0, SEEK_END);
+	return (uint64_t)_ftelli64(arg_file);
+#else
+	fseeko(arg_file, 0, SEEK_END);
+	return (uint64_t)ftello(arg_file);
+#endif
+}
+
+static bool ReadAll(FILE* arg_file, void* arg_data, size_t arg_bytes)
+{
+	return fread(arg_data, 1, arg_bytes, arg_file) == arg_bytes;
+}
+
+// LZ77 with an LZ4-like sequence format: a token holding the literal count
+// and match length in 4 bits each, longer counts continued in 255 steps,
+// the literals, then a 16-bit offset. The last sequence has literals only.
+static const int LZ_HASH_BITS = 16;
+static const size_t LZ_MIN_MATCH = 4;
+static const size_t LZ_MAX_OFFSET = 65535;
+
+static void PutLength(std::vector<uint8_t>& arg_out, size_t arg_length)
+{
+	while (arg_length >= 255)
+	{
+		arg_out.push_back(255);
+		arg_length -= 255;
+	}
+	arg_out.push_back((uint8_t)arg_length);
+}
+
+static bool GetLength(const uint8_t* arg_in, size_t arg_bytes, size_t& arg_pos, size_t& arg_length)
+{
+	uint8_t next;
+	do
+	{
+		if (arg_pos >= arg_bytes)
+		{
+			return false;
+		}
+		next = arg_in[arg_pos++];
+		arg_length += next;
+	} while (next == 255);
+	return true;
+}
+
+static void EmitSequence(std::vector<uint8_t>& arg_out, const uint8_t* arg_literals, size_t arg_literalCount,
+	size_t arg_offset, size_t arg_matchLength)
+{
+	size_t matchCode = arg_matchLength ? arg_matchLength - LZ_MIN_MATCH : 0;
+	arg_out.push_back((uint8_t)((std::min(arg_literalCount, (size_t)15) << 4) | std::min(matchCode, (size_t)15)));
+	if (arg_literalCount >= 15)
+	{
+		PutLength(arg_out, arg_literalCount - 15);
+	}
+	arg_out.insert(arg_out.end(), arg_literals, arg_literals + arg_literalCount);
+	if (arg_matchLength)
+	{
+		arg_out.push_back((uint8_t)(arg_offset & 0xff));
+		arg_out.push_back((uint8_t)(arg_offset >> 8));
+		if (matchCode >= 15)
+		{
+			PutLength(arg_out, matchCode - 15);
+		}
+	}
+}
+
+static void LzCompress(const uint8_t* arg_in, size_t arg_bytes, std::vector<uint8_t>& arg_out)
+{
+	arg_out.clear();
+	std::vector<int64_t> table((size_t)1 << LZ_HASH_BITS, -1);
+	size_t anchor = 0;
+	size_t i = 0;
+	while (i + LZ_MIN_MATCH <= arg_bytes)
+	{
+		uint32_t sequence;
+		memcpy(&sequence, arg_in + i, sizeof(sequence));
+		uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+		int64_t candidate = table[hash];
+		table[hash] = (int64_t)i;
+		if (candidate >= 0 && i - (size_t)candidate <= LZ_MAX_OFFSET && memcmp(arg_in + candidate, arg_in + i, LZ_MIN_MATCH) == 0)
+		{
+			size_t length = LZ_MIN_MATCH;
+			while (i + length < arg_bytes && arg_in[candidate + length] == arg_in[i + length])
+			{
+				length++;
+			}
+			EmitSequence(arg_out, arg_in + anchor, i - anchor, i - (size_t)candidate, length);
+			i += length;
+			anchor = i;
+		}
+		else
+		{
+			i++;
+		}
+	}
+	EmitSequence(arg_out, arg_in + anchor, arg_bytes - anchor, 0, 0);
+}
+
+static bool LzDecompress(const uint8_t* arg_in, size_t arg_bytes, uint8_t* arg_out, size_t arg_outBytes)
+{
+	size_t in = 0;
+	size_t out = 0;
+	while (in < arg_bytes)
+	{
+		uint8_t token = arg_in[in++];
+		size_t literals = token >> 4;
+		if (literals == 15 && !GetLength(arg_in, arg_bytes, in, literals))
+		{
+			return false;
+		}
+		if (literals > arg_bytes - in || literals > arg_outBytes - out)
+		{
+			return false;
+		}
+		memcpy(arg_out + out, arg_in + in, literals);
+		in += literals;
+		out += literals;
+		if (in == arg_bytes)
+		{
+			break;
+		}
+		if (arg_bytes - in < 2)
+		{
+			return false;
+		}
+		size_t offset = arg_in[in] | (arg_in[in + 1] << 8);
+		in += 2;
+		size_t length = token & 15;
+		if (length == 15 && !GetLength(arg_in, arg_bytes, in, length))
+		{
+			return false;
+		}
+		length += LZ_MIN_MATCH;
+		if (offset == 0 || offset > out || length > arg_outBytes - out)
+		{
+			return false;
+		}
+		// byte by byte, since a match may overlap the bytes it produces
+		for (size_t k = 0; k < length; k++) {
+			arg_out[out] = arg_out[out - offset];
+			out++;
+		}
+	}
+	return out == arg_outBytes;
+}
+
+// Order-0 rANS over bytes: a table of 256 frequencies summing to
+// RANS_TOTAL, the 32-bit final encoder state, then the renormalization
+// bytes in the order the decoder consumes them.
+static const int RANS_SCALE_BITS = 12;
+static const uint32_t RANS_TOTAL = 1u << RANS_SCALE_BITS;
+static const uint32_t RANS_LOW = 1u << 23;
+static const size_t RANS_TABLE_BYTES = 256 * sizeof(uint16_t);
+
+static void NormalizeFrequencies(const uint32_t* arg_counts, size_t arg_total, uint32_t* arg_freqs)
+{
+	uint32_t sum = 0;
+	for (int s = 0; s < 256; s++) {
+		arg_freqs[s] = arg_counts[s] ? std::max<uint32_t>(1, (uint32_t)((uint64_t)arg_counts[s] * RANS_TOTAL / arg_total)) : 0;
+		sum += arg_freqs[s];
+	}
+	// rounding leaves the sum slightly off, settle the difference on the most frequent symbols
+	while (sum != RANS_TOTAL)
+	{
+		int largest = (int)(std::max_element(arg_freqs, arg_freqs + 256) - arg_freqs);
+		if (sum < RANS_TOTAL)
+		{
+			arg_freqs[largest] += RANS_TOTAL - sum;
+			sum = RANS_TOTAL;
+		}
+		else
+		{
+			arg_freqs[largest]--;
+			sum--;
+		}
+	}
+}
+
+static void RansCompress(const uint8_t* arg_in, size_t arg_bytes, std::vector<uint8_t>& arg_out)
+{
+	uint32_t counts[256] = {};
+	for (size_t i = 0; i < arg_bytes; i++) {
+		counts[arg_in[i]]++;
+	}
+	uint32_t freqs[256], starts[256];
+	NormalizeFrequencies(counts, std::max<size_t>(arg_bytes, 1), freqs);
+	if (arg_bytes == 0)
+	{
+		freqs[0] = RANS_TOTAL;
+	}
+	uint32_t start = 0;
+	for (int s = 0; s < 256; s++) {
+		starts[s] = start;
+		start += freqs[s];
+	}
+
+	// a symbol never costs more than RANS_SCALE_BITS, so two bytes each is always enough
+	arg_out.assign(RANS_TABLE_BYTES + 2 * arg_bytes + sizeof(uint32_t), 0);
+	for (int s = 0; s < 256; s++) {
+		arg_out[2 * s] = (uint8_t)(freqs[s] & 0xff);
+		arg_out[2 * s + 1] = (uint8_t)(freqs[s] >> 8);
+	}
+	// encoded back to front, so the decoder reads forwards
+	uint8_t* end = arg_out.data() + arg_out.size();
+	uint8_t* cursor = end;
+	uint32_t state = RANS_LOW;
+	for (size_t i = arg_bytes; i-- > 0;) {
+		uint32_t freq = freqs[arg_in[i]];
+		uint32_t limit = ((RANS_LOW >> RANS_SCALE_BITS) << 8) * freq;
+		while (state >= limit)
+		{
+			*--cursor = (uint8_t)(state & 0xff);
+			state >>= 8;
+		}
+		state = ((state / freq) << RANS_SCALE_BITS) + (state % freq) + starts[arg_in[i]];
+	}
+	cursor -= sizeof(uint32_t);
+	for (int b = 0; b < 4; b++) {
+		cursor[b] = (uint8_t)(state >> (8 * b));
+	}
+	size_t streamBytes = end - cursor;
+	memmove(arg_out.data() + RANS_TABLE_BYTES, cursor, streamBytes);
+	arg_out.resize(RANS_TABLE_BYTES + streamBytes);
+}
+
+static bool RansDecompress(const uint8_t* arg_in, size_t arg_bytes, uint8_t* arg_out, size_t arg_outBytes)
+{
+	if (arg_bytes < RANS_TABLE_BYTES + sizeof(uint32_t))
+	{
+		return false;
+	}
+	uint32_t freqs[256], starts[256];
+	uint32_t start = 0;
+	for (int s = 0; s < 256; s++) {
+		freqs[s] = arg_in[2 * s] | (arg_in[2 * s + 1] << 8);
+		starts[s] = start;
+		start += freqs[s];
+	}
+	if (start != RANS_TOTAL)
+	{
+		return false;
+	}
+	uint8_t symbols[RANS_TOTAL];
+	for (int s = 0; s < 256; s++) {
+		memset(symbols + starts[s], s, freqs[s]);
+	}
+
+	const uint8_t* cursor = arg_in + RANS_TABLE_BYTES;
+	const uint8_t* end = arg_in + arg_bytes;
+	uint32_t state = 0;
+	for (int b = 0; b < 4; b++) {
+		state |= (uint32_t)cursor[b] << (8 * b);
+	}
+	cursor += sizeof(uint32_t);
+	for (size_t i = 0; i < arg_outBytes; i++) {
+		uint32_t slot = state & (RANS_TOTAL - 1);
+		uint8_t s = symbols[slot];
+		arg_out[i] = s;
+		state = freqs[s] * (state >> RANS_SCALE_BITS) + slot - starts[s];
+		while (state < RANS_LOW)
+		{
+			if (cursor == end)
+			{
+				return false;
+			}
+			state = (state << 8) | *cursor++;
+		}
+	}
+	return true;
+}
+
+// Residuals wrap modulo the code range and are zigzagged within it, so a
+// b-bit code always leaves a b-bit residual with small magnitudes near zero
+static inline uint32_t ZigZag(uint32_t arg_code, uint32_t arg_predicted, int arg_bits)
+{
+	uint32_t mask = (1u << arg_bits) - 1;
+	uint32_t wrapped = (arg_code - arg_predicted) & mask;
+	int32_t residual = wrapped >= (1u << (arg_bits - 1)) ? (int32_t)wrapped - (1 << arg_bits) : (int32_t)wrapped;
+	return residual >= 0 ? 2 * residual : -2 * residual - 1;
+}
+
+static inline uint32_t UnZigZag(uint32_t arg_value, uint32_t arg_predicted, int arg_bits)
+{
+	uint32_t mask = (1u << arg_bits) - 1;
+	int32_t residual = (arg_value & 1) ? -(int32_t)(arg_value >> 1) - 1 : (int32_t)(arg_value >> 1);
+	return (arg_predicted + residual) & mask;
+}
+
+static inline int BytesPerCode(int arg_bits)
+{
+	return arg_bits > 8 ? 2 : 1;
+}
+
+// Moves a field onto the channel's grid, leaving the zigzagged residuals in
+// byte planes, low bytes first, and the new codes in the channel
+static void QuantizeChannel(StreamChannel& arg_channel, const float* arg_field, size_t arg_cells, bool arg_keyframe,
+	std::vector<uint8_t>& arg_planes)
+{
+	const int bits = arg_channel.bits;
+	const int maxCode = (1 << bits) - 1;
+	// in double, so large values keep their fraction before rounding
+	const double inverse = 1.0 / arg_channel.quantum;
+	const int bytesPerCode = BytesPerCode(bits);
+	arg_planes.resize(arg_cells * bytesPerCode);
+	uint16_t* codes = arg_channel.codes.data();
+	uint32_t left = 0;
+	for (size_t i = 0; i < arg_cells; i++) {
+		int code = (int)std::floor(((double)arg_field[i] - arg_channel.origin) * inverse + 0.5);
+		code = std::min(std::max(code, 0), maxCode);
+		// keyframes predict from the previous cell in the row, later frames from the previous frame
+		uint32_t predicted = arg_keyframe ? left : codes[i];
+		uint32_t residual = ZigZag(code, predicted, bits);
+		arg_planes[i] = (uint8_t)(residual & 0xff);
+		if (bytesPerCode == 2)
+		{
+			arg_planes[arg_cells + i] = (uint8_t)(residual >> 8);
+		}
+		codes[i] = (uint16_t)code;
+		left = code;
+	}
+}
+
+// Appends a StreamChannelHeader and the smallest of the raw, LZ and rANS codings
+static void AppendBlock(const StreamChannel& arg_channel, const std::vector<uint8_t>& arg_planes,
+	std::vector<uint8_t>& arg_packed, std::vector<uint8_t>& arg_entropy, std::vector<uint8_t>& arg_out)
+{
+	LzCompress(arg_planes.data(), arg_planes.size(), arg_packed);
+	RansCompress(arg_planes.data(), arg_planes.size(), arg_entropy);
+	StreamChannelHeader header;
+	header.origin = arg_channel.origin;
+	header.quantum = arg_channel.quantum;
+	header.bits = arg_channel.bits;
+	const std::vector<uint8_t>* chosen = &arg_planes;
+	header.method = METHOD_RAW;
+	if (arg_packed.size() < chosen->size())
+	{
+		chosen = &arg_packed;
+		header.method = METHOD_LZ;
+	}
+	if (arg_entropy.size() < chosen->size())
+	{
+		chosen = &arg_entropy;
+		header.method = METHOD_RANS;
+	}
+	header.packedBytes = (uint32_t)chosen->size();
+	const uint8_t* headerBytes = (const uint8_t*)&header;
+	arg_out.insert(arg_out.end(), headerBytes, headerBytes + sizeof(header));
+	arg_out.insert(arg_out.end(), chosen->begin(), chosen->end());
+}
+
+static bool UnpackBlock(const StreamChannelHeader& arg_block, const uint8_t* arg_data, size_t arg_cells, std::vector<uint8_t>& arg_planes)
+{
+	if (arg_block.bits != 8 && arg_block.bits != 12 && arg_block.bits != 16)
+	{
+		return false;
+	}
+	arg_planes.resize(arg_cells * BytesPerCode(arg_block.bits));
+	switch (arg_block.method) {
+	case METHOD_RAW:
+		if (arg_block.packedBytes != arg_planes.size())
+		{
+			return false;
+		}
+		memcpy(arg_planes.data(), arg_data, arg_planes.size());
+		return true;
+	case METHOD_LZ:
+		return LzDecompress(arg_data, arg_block.packedBytes, arg_planes.data(), arg_planes.size());
+	case METHOD_RANS:
+		return RansDecompress(arg_data, arg_block.packedBytes, arg_planes.data(), arg_planes.size());
+	}
+	return false;
+}
+
+// Applies a block's residual planes to the channel's codes and takes over its grid
+static void RebuildChannel(StreamChannel& arg_channel, const StreamChannelHeader& arg_block, const std::vector<uint8_t>& arg_planes,
+	size_t arg_cells, bool arg_keyframe)
+{
+	arg_channel.origin = arg_block.origin;
+	arg_channel.quantum = arg_block.quantum;
+	arg_channel.bits = arg_block.bits;
+	const bool wide = BytesPerCode(arg_block.bits) == 2;
+	uint16_t* codes = arg_channel.codes.data();
+	uint32_t left = 0;
+	for (size_t i = 0; i < arg_cells; i++) {
+		uint32_t residual = arg_planes[i];
+		if (wide)
+		{
+			residual |= arg_planes[arg_cells + i] << 8;
+		}
+		uint32_t predicted = arg_keyframe ? left : codes[i];
+		codes[i] = (uint16_t)UnZigZag(residual, predicted, arg_block.bits);
+		left = codes[i];
+	}
+}
+
+static void Dequantize(const StreamChannel& arg_channel, size_t arg_cells, float* arg_out)
+{
+	for (size_t i = 0; i < arg_cells; i++) {
+		arg_out[i] = (float)(arg_channel.origin + arg_channel.codes[i] * (double)arg_channel.quantum);
+	}
+}
+
+// The grid covers exactly the field's range, as there is no later frame to drift into
+void EncodeField(const float* arg_field, size_t arg_cells, int arg_bits, std::vector<uint8_t>& arg_out)
+{
+	StreamChannel channel;
+	float lowest = FLT_MAX;
+	float highest = -FLT_MAX;
+	for (size_t i = 0; i < arg_cells; i++) {
+		lowest = std::min(lowest, arg_field[i]);
+		highest = std::max(highest, arg_field[i]);
+	}
+	float span = highest - lowest;
+	if (!(span > 0.0f))
+	{
+		span = std::max(std::fabs(lowest), 1.0f) * 1e-6f;
+	}
+	channel.bits = arg_bits;
+	channel.origin = lowest;
+	channel.quantum = span / ((1 << arg_bits) - 1);
+	channel.codes.resize(arg_cells);
+	std::vector<uint8_t> planes, packed, entropy;
+	QuantizeChannel(channel, arg_field, arg_cells, true, planes);
+	AppendBlock(channel, planes, packed, entropy, arg_out);
+}
+
+bool DecodeField(const uint8_t* arg_data, size_t arg_bytes, size_t arg_cells, float* arg_out)
+{
+	StreamChannelHeader block;
+	if (arg_bytes < sizeof(block))
+	{
+		return false;
+	}
+	memcpy(&block, arg_data, sizeof(block));
+	std::vector<uint8_t> planes;
+	if (block.packedBytes != arg_bytes - sizeof(block) || !UnpackBlock(block, arg_data + sizeof(block), arg_cells, planes))
+	{
+		return false;
+	}
+	StreamChannel channel;
+	channel.codes.resize(arg_cells);
+	RebuildChannel(channel, block, planes, arg_cells, true);
+	Dequantize(channel, arg_cells, arg_out);
+	return true;
+}
+
+FieldStreamWriter* FieldStreamWriter::Create(const char* arg_path, const StreamConfig& arg_config)
+{
+	bool valid = arg_config.width > 0 && arg_config.height > 0 && arg_config.keyframeInterval > 0
+		&& arg_config.errorBound >= 0.0f && (arg_config.bits == 8 || arg_config.bits == 12 || arg_config.bits == 16);
+	FILE* file = valid ? fopen(arg_path, "wb") : nullptr;
+	if (!file)
+	{
+		return nullptr;
+	}
+	FieldStreamWriter* writer = new FieldStreamWriter(arg_config, file);
+	if (writer->failed)
+	{
+		delete writer;
+		return nullptr;
+	}
+	return writer;
+}
+
+FieldStreamWriter::FieldStreamWriter(const StreamConfig& arg_config, FILE* arg_file)
+	: config(arg_config), file(arg_file), failed(false), bytesWritten(0), maxError(0.0f), sinceKeyframe(0)
+{
+	channels.resize(config.withVelocity ? 3 : 1);
+	for (StreamChannel& channel : channels) {
+		channel.origin = 0.0f;
+		channel.quantum = 1.0f;
+		channel.bits = config.bits;
+		channel.codes.assign((size_t)config.width * config.height, 0);
+	}
+	StreamHeader header = {};
+	memcpy(header.magic, STREAM_MAGIC, sizeof(header.magic));
+	header.version = STREAM_VERSION;
+	header.width = config.width;
+	header.height = config.height;
+	header.channels = (uint32_t)channels.size();
+	write(&header, sizeof(header));
+}
+
+FieldStreamWriter::~FieldStreamWriter()
+{
+	close();
+}
+
+void FieldStreamWriter::write(const void* arg_data, size_t arg_bytes)
+{
+	if (fwrite(arg_data, 1, arg_bytes, file) != arg_bytes)
+	{
+		failed = true;
+	}
+	bytesWritten += arg_bytes;
+}
+
+bool FieldStreamWriter::fitsGrid(const StreamChannel& arg_channel, const float* arg_field) const
+{
+	const size_t cells = (size_t)config.width * config.height;
+	float lowest = arg_channel.origin - 0.5f * arg_channel.quantum;
+	float highest = arg_channel.origin + ((1 << arg_channel.bits) - 0.5f) * arg_channel.quantum;
+	for (size_t i = 0; i < cells; i++) {
+		// written so a NaN fails too
+		if (!(arg_field[i] >= lowest && arg_field[i] <= highest))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// The grid spans twice the field's current range, centred on it, so values
+// can drift for a while before a new keyframe is needed
+void FieldStreamWriter::placeGrid(StreamChannel& arg_channel, const float* arg_field)
+{
+	const size_t cells = (size_t)config.width * config.height;
+	float lowest = FLT_MAX;
+	float highest = -FLT_MAX;
+	for (size_t i = 0; i < cells; i++) {
+		lowest = std::min(lowest, arg_field[i]);
+		highest = std::max(highest, arg_field[i]);
+	}
+	float span = 2.0f * (highest - lowest);
+	if (!(span > 0.0f))
+	{
+		// a constant field, any grid through the value will do
+		span = std::max(std::fabs(lowest), 1.0f) * 1e-6f;
+	}
+	if (config.errorBound > 0.0f)
+	{
+		arg_channel.bits = 0;
+		arg_channel.quantum = 2.0f * config.errorBound;
+		for (int bits = 8; bits <= 16 && arg_channel.bits == 0; bits += 4) {
+			if (span <= arg_channel.quantum * ((1 << bits) - 1))
+			{
+				arg_channel.bits = bits;
+			}
+		}
+		if (arg_channel.bits == 0)
+		{
+			// too wide for the bound even at 16 bits, loosen it for this keyframe
+			arg_channel.bits = 16;
+			arg_channel.quantum = span / 65535;
+		}
+	}
+	else
+	{
+		arg_channel.bits = config.bits;
+		arg_channel.quantum = span / ((1 << config.bits) - 1);
+	}
+	arg_channel.origin = 0.5f * (lowest + highest) - 0.5f * arg_channel.quantum * ((1 << arg_channel.bits) - 1);
+	maxError = std::max(maxError, 0.5f * arg_channel.quantum);
+}
+
+void FieldStreamWriter::encodeChannel(StreamChannel& arg_channel, const float* arg_field, bool arg_keyframe)
+{
+	if (arg_keyframe)
+	{
+		placeGrid(arg_channel, arg_field);
+	}
+	QuantizeChannel(arg_channel, arg_field, (size_t)config.width * config.height, arg_keyframe, planes);
+	AppendBlock(arg_channel, planes, packed, entropy, payload);
+}
+
+bool FieldStreamWriter::writeFrame(uint64_t arg_step, const float* arg_density, const float* arg_veloX, const float* arg_veloY)
+{
+	if (!file || failed)
+	{
+		return false;
+	}
+	const float* fields[3] = { arg_density, arg_veloX, arg_veloY };
+	bool keyframe = index.empty() || sinceKeyframe >= config.keyframeInterval;
+	for (size_t c = 0; c < channels.size() && !keyframe; c++) {
+		keyframe = !fitsGrid(channels[c], fields[c]);
+	}
+	payload.clear();
+	for (size_t c = 0; c < channels.size(); c++) {
+		encodeChannel(channels[c], fields[c], keyframe);
+	}
+	sinceKeyframe = keyframe ? 1 : sinceKeyframe + 1;
+
+	StreamIndexEntry entry = {};
+	entry.offset = bytesWritten;
+	entry.step = arg_step;
+	entry.keyframe = keyframe;
+	StreamFrameHeader header = {};
+	header.tag = FRAME_TAG;
+	header.keyframe = keyframe;
+	header.step = arg_step;
+	header.payloadBytes = payload.size();
+	write(&header, sizeof(header));
+	write(payload.data(), payload.size());
+	index.push_back(entry);
+	return !failed;
+}
+
+bool FieldStreamWriter::writeFrame(const RuntimeSimulator& arg_simulator, uint64_t arg_step)
+{
+	// the encoder reads width * height values per channel, whatever the simulator holds
+	if (arg_simulator.getWidth() != config.width || arg_simulator.getHeight() != config.height)
+	{
+		return false;
+	}
+	const size_t cells = (size_t)config.width * config.height;
+	scratch.resize(cells * channels.size());
+	arg_simulator.readDensity(scratch.data());
+	if (config.withVelocity)
+	{
+		arg_simulator.readVelocity(scratch.data() + cells, scratch.data() + 2 * cells);
+		return writeFrame(arg_step, scratch.data(), scratch.data() + cells, scratch.data() + 2 * cells);
+	}
+	return writeFrame(arg_step, scratch.data(), nullptr, nullptr);
+}
+
+bool FieldStreamWriter::close()
+{
+	if (!file)
+	{
+		return !failed;
+	}
+	StreamTrailer trailer = {};
+	trailer.indexOffset = bytesWritten;
+	trailer.frameCount = (uint32_t)index.size();
+	memcpy(trailer.tag, INDEX_TAG, sizeof(trailer.tag));
+	if (!index.empty())
+	{
+		write(index.data(), index.size() * sizeof(StreamIndexEntry));
+	}
+	write(&trailer, sizeof(trailer));
+	if (fclose(file) != 0)
+	{
+		failed = true;
+	}
+	file = nullptr;
+	return !failed;
+}
+
+FieldStreamReader* FieldStreamReader::Open(const char* arg_path)
+{
+	FieldStreamReader* reader = new FieldStreamReader();
+	reader->file = fopen(arg_path, "rb");
+	StreamHeader& header = reader->header;
+	bool valid = reader->file && ReadAll(reader->file, &header, sizeof(header))
+		&& memcmp(header.magic, STREAM_MAGIC, sizeof(header.magic)) == 0 && header.version == STREAM_VERSION
+		&& header.width > 0 && header.height > 0 && (header.channels == 1 || header.channels == 3)
+		&& reader->loadIndex();
+	if (!valid)
+	{
+		delete reader;
+		return nullptr;
+	}
+	reader->channels.resize(header.channels);
+	for (StreamChannel& channel : reader->channels) {
+		channel.codes.assign((size_t)header.width * header.height, 0);
+	}
+	return reader;
+}
+
+FieldStreamReader::~FieldStreamReader()
+{
+	if (file)
+	{
+		fclose(file);
+	}
+}
+
+bool FieldStreamReader::loadIndex()
+{
+	uint64_t fileBytes = FileSize(file);
+	StreamTrailer trailer;
+	if (fileBytes >= sizeof(StreamHeader) + sizeof(trailer) && SeekTo(file, fileBytes - sizeof(trailer))
+		&& ReadAll(file, &trailer, sizeof(trailer)) && memcmp(trailer.tag, INDEX_TAG, sizeof(trailer.tag)) == 0
+		&& trailer.indexOffset + (uint64_t)trailer.frameCount * sizeof(StreamIndexEntry) + sizeof(trailer) == fileBytes)
+	{
+		index.resize(trailer.frameCount);
+		return trailer.frameCount == 0 || (SeekTo(file, trailer.indexOffset)
+			&& ReadAll(file, index.data(), index.size() * sizeof(StreamIndexEntry)));
+	}
+
+	// no index, the writer never got to close(): walk the frame headers instead
+	uint64_t offset = sizeof(StreamHeader);
+	StreamFrameHeader frame;
+	while (offset + sizeof(frame) <= fileBytes && SeekTo(file, offset) && ReadAll(file, &frame, sizeof(frame))
+		&& frame.tag == FRAME_TAG && frame.payloadBytes <= fileBytes - offset - sizeof(frame))
+	{
+		StreamIndexEntry entry = {};
+		entry.offset = offset;
+		entry.step = frame.step;
+		entry.keyframe = frame.keyframe;
+		index.push_back(entry);
+		offset += sizeof(frame) + frame.payloadBytes;
+	}
+	return true;
+}
+
+bool FieldStreamReader::decodeFrame(int arg_frame)
+{
+	const size_t cells = (size_t)header.width * header.height;
+	StreamFrameHeader frame;
+	if (!SeekTo(file, index[arg_frame].offset) || !ReadAll(file, &frame, sizeof(frame)) || frame.tag != FRAME_TAG)
+	{
+		return false;
+	}
+	for (StreamChannel& channel : channels) {
+		StreamChannelHeader block;
+		if (!ReadAll(file, &block, sizeof(block)) || block.packedBytes > frame.payloadBytes)
+		{
+			return false;
+		}
+		packed.resize(block.packedBytes);
+		if (!ReadAll(file, packed.data(), packed.size()) || !UnpackBlock(block, packed.data(), cells, planes))
+		{
+			return false;
+		}
+		RebuildChannel(channel, block, planes, cells, frame.keyframe != 0);
+	}
+	return true;
+}
+
+bool FieldStreamReader::readFrame(int arg_frame, float* arg_density, float* arg_veloX, float* arg_veloY)
+{
+	if (arg_frame < 0 || arg_frame >= (int)index.size())
+	{
+		return false;
+	}
+	int keyframe = arg_frame;
+	while (keyframe >= 0 && !index[keyframe].keyframe)
+	{
+		keyframe--;
+	}
+	if (keyframe < 0)
+	{
+		return false;
+	}
+	// carry on from the codes already held when they lie between the keyframe and the target
+	int first = decoded >= keyframe && decoded <= arg_frame ? decoded + 1 : keyframe;
+	for (int f = first; f <= arg_frame; f++) {
+		if (!decodeFrame(f))
+		{
+			decoded = -1;
+			return false;
+		}
+		decoded = f;
+	}
+
+	const size_t cells = (size_t)header.width * header.height;
+	float* outputs[3] = { arg_density, arg_veloX, arg_veloY };
+	for (size_t c = 0; c < channels.size(); c++) {
+		if (!outputs[c])
+		{
+			continue;
+		}
+		Dequantize(channels[c], cells, outputs[c]);
+	}
+	return true;
+}
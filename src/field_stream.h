@@ -0,0 +1,171 @@
+#pragma once
+#ifndef FIELD_STREAM_H
+#define FIELD_STREAM_H
+#include "runtime_simulator.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+class StreamConfig
+{
+public:
+	int width, height;
+	// also store both velocity components after the density
+	bool withVelocity;
+	// code width, 8, 12 or 16; ignored when errorBound is set
+	int bits;
+	// largest absolute error allowed per value, 0 spends all of bits on each keyframe's range
+	float errorBound;
+	// frames between forced keyframes, bounding how far a seek decodes
+	int keyframeInterval;
+	StreamConfig()
+		: width(SIZE), height(SIZE), withVelocity(false), bits(12), errorBound(0.0f), keyframeInterval(30) {}
+};
+
+// Stream file layout, little endian:
+//   StreamHeader
+//   frames, each a StreamFrameHeader and then one block per channel:
+//     StreamChannelHeader and packedBytes of coded residuals
+//   the index, one StreamIndexEntry per frame
+//   StreamTrailer
+// Each keyframe fixes a quantization grid per channel, origin + code * quantum,
+// wide enough for the field to drift before the next keyframe. Keyframe codes
+// are predicted from their left neighbour and later frames from the same cell
+// in the previous frame. Residuals are split into byte planes and coded with
+// LZ or rANS, whichever is smaller. A stream cut short has no index; the
+// reader then rebuilds it from the frame headers.
+class StreamHeader
+{
+public:
+	char magic[8];
+	uint32_t version;
+	int32_t width, height;
+	uint32_t channels;
+};
+
+class StreamFrameHeader
+{
+public:
+	uint32_t tag;
+	uint32_t keyframe;
+	uint64_t step;
+	// every channel block of the frame
+	uint64_t payloadBytes;
+};
+
+class StreamChannelHeader
+{
+public:
+	float origin, quantum;
+	uint32_t bits;
+	// see StreamMethod in field_stream.cpp
+	uint32_t method;
+	uint32_t packedBytes;
+};
+
+class StreamIndexEntry
+{
+public:
+	uint64_t offset;
+	uint64_t step;
+	uint32_t keyframe;
+	uint32_t reserved;
+};
+
+class StreamTrailer
+{
+public:
+	uint64_t indexOffset;
+	uint32_t frameCount;
+	char tag[4];
+};
+
+// Quantization state of one field, shared by the writer and the reader
+class StreamChannel
+{
+public:
+	float origin, quantum;
+	int bits;
+	std::vector<uint16_t> codes;
+};
+
+// One field coded on its own, as a StreamChannelHeader and its packed
+// residuals, the way a stream codes a keyframe. For frames sent singly,
+// e.g. by FrameServer.
+void EncodeField(const float* arg_field, size_t arg_cells, int arg_bits, std::vector<uint8_t>& arg_out);
+// false if the block is damaged or does not hold arg_cells values
+bool DecodeField(const uint8_t* arg_data, size_t arg_bytes, size_t arg_cells, float* arg_out);
+
+// Writes frames as they are produced; the index goes out on close()
+class FieldStreamWriter
+{
+public:
+	// returns nullptr if the file cannot be created or the config is invalid
+	static FieldStreamWriter* Create(const char* arg_path, const StreamConfig& arg_config);
+	FieldStreamWriter(const FieldStreamWriter&) = delete;
+	FieldStreamWriter& operator=(const FieldStreamWriter&) = delete;
+	~FieldStreamWriter();
+	// row-major width * height arrays; the velocity ones are ignored without withVelocity
+	bool writeFrame(uint64_t arg_step, const float* arg_density, const float* arg_veloX, const float* arg_veloY);
+	// false if the simulator's grid is not the configured one
+	bool writeFrame(const RuntimeSimulator& arg_simulator, uint64_t arg_step);
+	// writes the index and trailer, returns false if any write failed
+	bool close();
+	uint64_t getBytesWritten() const { return bytesWritten; }
+	// worst error bound actually used, above errorBound only when 16 bits cannot cover a range
+	float getMaxError() const { return maxError; }
+
+private:
+	StreamConfig config;
+	FILE* file;
+	bool failed;
+	uint64_t bytesWritten;
+	float maxError;
+	int sinceKeyframe;
+	std::vector<StreamChannel> channels;
+	std::vector<StreamIndexEntry> index;
+	std::vector<float> scratch;
+	// residual byte planes, their LZ and rANS codings, and the frame being assembled
+	std::vector<uint8_t> planes, packed, entropy, payload;
+
+	FieldStreamWriter(const StreamConfig& arg_config, FILE* arg_file);
+	bool fitsGrid(const StreamChannel& arg_channel, const float* arg_field) const;
+	void placeGrid(StreamChannel& arg_channel, const float* arg_field);
+	void encodeChannel(StreamChannel& arg_channel, const float* arg_field, bool arg_keyframe);
+	void write(const void* arg_data, size_t arg_bytes);
+};
+
+// Random access to a stream. Frames are rebuilt from the nearest keyframe
+// at or before them, or carried on from the last frame read when reading
+// forwards.
+class FieldStreamReader
+{
+public:
+	// returns nullptr if the file is missing or not a stream
+	static FieldStreamReader* Open(const char* arg_path);
+	FieldStreamReader(const FieldStreamReader&) = delete;
+	FieldStreamReader& operator=(const FieldStreamReader&) = delete;
+	~FieldStreamReader();
+	int getWidth() const { return header.width; }
+	int getHeight() const { return header.height; }
+	bool hasVelocity() const { return header.channels == 3; }
+	int getFrameCount() const { return (int)index.size(); }
+	uint64_t getStep(int arg_frame) const { return index[arg_frame].step; }
+	// fills width * height arrays, any of which may be nullptr; false on a damaged frame
+	bool readFrame(int arg_frame, float* arg_density, float* arg_veloX, float* arg_veloY);
+
+private:
+	StreamHeader header;
+	FILE* file;
+	std::vector<StreamIndexEntry> index;
+	std::vector<StreamChannel> channels;
+	// frame the channel codes currently hold, -1 for none
+	int decoded;
+	std::vector<uint8_t> planes, packed;
+
+	FieldStreamReader() : file(nullptr), decoded(-1) {}
+	bool loadIndex();
+	bool decodeFrame(int arg_frame);
+};
+
+#endif
@@ -1,20 +1,73 @@
 #include "fluid.h"
+#include <xmmintrin.h>
 
-FluidCell::FluidCell(float arg_diffusion, float arg_viscocity, float arg_dt)
+template <typename Layout, typename Precision>
+FluidCell<Layout, Precision>::FluidCell(float arg_diffusion, float arg_viscocity, float arg_dt, int arg_width, int arg_height,
+	float arg_cellSizeX, float arg_cellSizeY)
+	: width(arg_width), height(arg_height), layout(arg_width, arg_height, sizeof(Storage))
 {
-	size = SIZE;
+	// all planes live in one allocation, laid out back to back; it starts on a
+	// cache line so padded rows do too
+	planes = (Storage*)_mm_malloc(sizeof(Storage) * NUM_PLANES * layout.storageSize(), 64);
+	ownsPlanes = true;
+	init(arg_diffusion, arg_viscocity, arg_dt, arg_cellSizeX, arg_cellSizeY);
+	clear();
+}
+
+template <typename Layout, typename Precision>
+FluidCell<Layout, Precision>::FluidCell(float arg_diffusion, float arg_viscocity, float arg_dt, int arg_width, int arg_height,
+	float arg_cellSizeX, float arg_cellSizeY, Storage* arg_planes)
+	: width(arg_width), height(arg_height), layout(arg_width, arg_height, sizeof(Storage))
+{
+	planes = arg_planes;
+	ownsPlanes = false;
+	init(arg_diffusion, arg_viscocity, arg_dt, arg_cellSizeX, arg_cellSizeY);
+}
+
+template <typename Layout, typename Precision>
+void FluidCell<Layout, Precision>::init(float arg_diffusion, float arg_viscocity, float arg_dt, float arg_cellSizeX, float arg_cellSizeY)
+{
+	float defaultCellSize = 1.0f / ((width > height ? width : height) - 2);
+	cellSizeX = arg_cellSizeX > 0.0f ? arg_cellSizeX : defaultCellSize;
+	cellSizeY = arg_cellSizeY > 0.0f ? arg_cellSizeY : defaultCellSize;
 	dt = arg_dt;
 	diffusion = arg_diffusion;
 	viscocity = arg_viscocity;
-	for (int i = 0; i < SIZE * SIZE; i++)
+
+	int planeSize = layout.storageSize();
+	velocityX.current = planes;
+	velocityX.previous = planes + planeSize;
+	velocityY.current = planes + 2 * planeSize;
+	velocityY.previous = planes + 3 * planeSize;
+	density.current = planes + 4 * planeSize;
+	density.previous = planes + 5 * planeSize;
+	pressure = planes + 6 * planeSize;
+	divergence = planes + 7 * planeSize;
+}
+
+template <typename Layout, typename Precision>
+FluidCell<Layout, Precision>::~FluidCell()
+{
+	if (ownsPlanes)
 	{
-		velocityX[i] = velocityX_prev[i] = 0.0f;
-		density[i] = density_prev[i] = 0.0f;
-		velocityY[i] = velocityY_prev[i] = 0.0f;
+		_mm_free(planes);
 	}
 }
 
-FluidCell::~FluidCell()
+template <typename Layout, typename Precision>
+void FluidCell<Layout, Precision>::clear()
 {
-	delete[] velocityX, velocityX_prev, velocityY, velocityY_prev, density, density_prev;
-}
\ No newline at end of file
+	int planeSize = layout.storageSize();
+	for (int i = 0; i < NUM_PLANES * planeSize; i++)
+	{
+		planes[i] = Storage(0.0f);
+	}
+}
+
+template class FluidCell<RowMajorLayout>;
+template class FluidCell<TiledLayout<8>>;
+template class FluidCell<TiledLayout<16>>;
+template class FluidCell<MortonLayout>;
+template class FluidCell<RowMajorLayout, DoublePrecision>;
+template class FluidCell<RowMajorLayout, HalfPrecision>;
+template class FluidCell<RowMajorLayout, BFloat16Precision>;
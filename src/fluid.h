@@ -1,21 +1,61 @@
 #pragma once
 #ifndef FLUID_H
 #define FLUID_H
+#include "layout.h"
+#include "precision.h"
+#include <utility>
 #define SIZE 64
 
+// A double buffered plane: kernels read from current and write into previous,
+// then swap() flips the roles without copying any data
+template <typename T>
+class FluidField
+{
+public:
+	T* current;
+	T* previous;
+	FluidField() : current(nullptr), previous(nullptr) {}
+	void swap() { std::swap(current, previous); }
+};
+
+template <typename Layout, typename Precision = FloatPrecision>
 class FluidCell
 {
 public:
-	int size;
-	float diffusion, viscocity, dt;
-	float velocityX[SIZE * SIZE];
-	float velocityX_prev[SIZE * SIZE];
-	float velocityY[SIZE * SIZE];
-	float velocityY_prev[SIZE * SIZE];
-	float density[SIZE * SIZE];
-	float density_prev[SIZE * SIZE];
-	FluidCell(float arg_diffusion, float arg_viscocity, float arg_dt);
+	typedef typename Precision::storage_type Storage;
+	typedef typename Precision::compute_type Compute;
+	static const int NUM_PLANES = 8;
+
+	int width, height;
+	// physical spacing between cell centres along each axis
+	Compute cellSizeX, cellSizeY;
+	Compute diffusion, viscocity, dt;
+	Layout layout;
+	FluidField<Storage> velocityX;
+	FluidField<Storage> velocityY;
+	FluidField<Storage> density;
+	// scratch planes for the pressure solve, never aliased with the fields above
+	Storage* pressure;
+	Storage* divergence;
+	// the cell spacing defaults to square cells with the longer axis spanning one unit
+	FluidCell(float arg_diffusion, float arg_viscocity, float arg_dt, int arg_width = SIZE, int arg_height = SIZE,
+		float arg_cellSizeX = 0.0f, float arg_cellSizeY = 0.0f);
+	// runs on NUM_PLANES * layout.storageSize() values at arg_planes, which the
+	// caller keeps alive and the cell neither clears nor frees; used to run
+	// straight out of a mapped checkpoint
+	FluidCell(float arg_diffusion, float arg_viscocity, float arg_dt, int arg_width, int arg_height,
+		float arg_cellSizeX, float arg_cellSizeY, Storage* arg_planes);
+	FluidCell(const FluidCell&) = delete;
+	FluidCell& operator=(const FluidCell&) = delete;
 	~FluidCell();
+	// zeroes every plane, so a cell can be reused for a fresh run
+	void clear();
+	// the arena holding all planes, back to back
+	Storage* getPlanes() const { return planes; }
+private:
+	Storage* planes;
+	bool ownsPlanes;
+	void init(float arg_diffusion, float arg_viscocity, float arg_dt, float arg_cellSizeX, float arg_cellSizeY);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,45 @@
+#include "fluid3d.h"
+#include <xmmintrin.h>
+
+static const int NUM_VOLUMES = 10;
+
+template <typename Layout, typename Precision>
+FluidCell3D<Layout, Precision>::FluidCell3D(float arg_diffusion, float arg_viscocity, float arg_dt, int arg_size)
+	: layout(arg_size, arg_size, arg_size, sizeof(Storage))
+{
+	size = arg_size;
+	dt = arg_dt;
+	diffusion = arg_diffusion;
+	viscocity = arg_viscocity;
+
+	// all volumes live in one allocation, laid out back to back; it starts on
+	// a cache line so padded rows do too
+	int volumeSize = layout.storageSize();
+	volumes = (Storage*)_mm_malloc(sizeof(Storage) * NUM_VOLUMES * volumeSize, 64);
+	for (int i = 0; i < NUM_VOLUMES * volumeSize; i++)
+	{
+		volumes[i] = Storage(0.0f);
+	}
+	velocityX.current = volumes;
+	velocityX.previous = volumes + volumeSize;
+	velocityY.current = volumes + 2 * volumeSize;
+	velocityY.previous = volumes + 3 * volumeSize;
+	velocityZ.current = volumes + 4 * volumeSize;
+	velocityZ.previous = volumes + 5 * volumeSize;
+	density.current = volumes + 6 * volumeSize;
+	density.previous = volumes + 7 * volumeSize;
+	pressure = volumes + 8 * volumeSize;
+	divergence = volumes + 9 * volumeSize;
+}
+
+template <typename Layout, typename Precision>
+FluidCell3D<Layout, Precision>::~FluidCell3D()
+{
+	_mm_free(volumes);
+}
+
+template class FluidCell3D<RowMajorLayout3D>;
+template class FluidCell3D<TiledLayout3D<4>>;
+template class FluidCell3D<TiledLayout3D<8>>;
+template class FluidCell3D<RowMajorLayout3D, DoublePrecision>;
+template class FluidCell3D<RowMajorLayout3D, HalfPrecision>;
@@ -0,0 +1,32 @@
+#pragma once
+#ifndef FLUID3D_H
+#define FLUID3D_H
+#include "fluid.h"
+
+// Volumetric counterpart of FluidCell: a cubic grid of size^3 cells
+template <typename Layout, typename Precision = FloatPrecision>
+class FluidCell3D
+{
+public:
+	typedef typename Precision::storage_type Storage;
+	typedef typename Precision::compute_type Compute;
+
+	int size;
+	Compute diffusion, viscocity, dt;
+	Layout layout;
+	FluidField<Storage> velocityX;
+	FluidField<Storage> velocityY;
+	FluidField<Storage> velocityZ;
+	FluidField<Storage> density;
+	// scratch planes for the pressure solve, never aliased with the fields above
+	Storage* pressure;
+	Storage* divergence;
+	FluidCell3D(float arg_diffusion, float arg_viscocity, float arg_dt, int arg_size);
+	FluidCell3D(const FluidCell3D&) = delete;
+	FluidCell3D& operator=(const FluidCell3D&) = delete;
+	~FluidCell3D();
+private:
+	Storage* volumes;
+};
+
+#endif
@@ -0,0 +1,302 @@
+#include "frame_ring.h"
+#include <cstring>
+#include <new>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char RING_MAGIC[8] = { 'F', 'L', 'U', 'I', 'D', 'R', 'G', 0 };
+
+// POSIX names start with a slash, Windows ones live in the session namespace
+static std::string RegionName(const char* arg_name)
+{
+#ifdef _WIN32
+	return std::string("Local\\") + arg_name;
+#else
+	return arg_name[0] == '/' ? std::string(arg_name) : std::string("/") + arg_name;
+#endif
+}
+
+FrameRing* FrameRing::Create(const char* arg_name, const FrameRingConfig& arg_config)
+{
+	if (arg_config.width < 1 || arg_config.height < 1 || arg_config.slots < 1)
+	{
+		return nullptr;
+	}
+	uint32_t channels = arg_config.withVelocity ? 3 : 1;
+	uint64_t dataBytes = (uint64_t)channels * arg_config.width * arg_config.height * sizeof(float);
+	// whole cache lines per slot, so neighbouring slots never share one
+	uint64_t slotBytes = (RING_SLOT_HEADER_BYTES + dataBytes + 63) & ~(uint64_t)63;
+	uint64_t totalBytes = RING_HEADER_BYTES + arg_config.slots * slotBytes;
+
+	FrameRing* ring = new FrameRing();
+	ring->name = RegionName(arg_name);
+	ring->owner = true;
+#ifdef _WIN32
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)(totalBytes >> 32), (DWORD)totalBytes, ring->name.c_str());
+	// an existing region keeps its old size, so it cannot be taken over
+	if (mapping && GetLastError() != ERROR_ALREADY_EXISTS)
+	{
+		ring->handle = mapping;
+		ring->base = (char*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	}
+	else if (mapping)
+	{
+		CloseHandle(mapping);
+	}
+#else
+	shm_unlink(ring->name.c_str());
+	int file = shm_open(ring->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (file >= 0 && ftruncate(file, (off_t)totalBytes) == 0)
+	{
+		void* mapping = mmap(nullptr, (size_t)totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if (mapping != MAP_FAILED)
+		{
+			ring->base = (char*)mapping;
+		}
+	}
+	if (file >= 0)
+	{
+		close(file);
+	}
+#endif
+	if (!ring->base)
+	{
+		delete ring;
+		return nullptr;
+	}
+	ring->mappingBytes = (size_t)totalBytes;
+
+	// a fresh region is zeroed, so every slot starts at sequence 0
+	RingHeader* header = new (ring->base) RingHeader();
+	header->version = RING_VERSION;
+	header->width = arg_config.width;
+	header->height = arg_config.height;
+	header->channels = channels;
+	header->slotCount = arg_config.slots;
+	header->slotBytes = slotBytes;
+	header->published.store(0, std::memory_order_relaxed);
+	for (int i = 0; i < arg_config.slots; i++) {
+		new (ring->base + RING_HEADER_BYTES + i * slotBytes) RingSlotHeader();
+	}
+	// the magic goes in last, so a consumer attaching early never sees half a header
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(header->magic, RING_MAGIC, sizeof(header->magic));
+	ring->header = header;
+	return ring;
+}
+
+FrameRing* FrameRing::Attach(const char* arg_name)
+{
+	FrameRing* ring = new FrameRing();
+	ring->name = RegionName(arg_name);
+	size_t regionBytes = 0;
+#ifdef _WIN32
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, ring->name.c_str());
+	if (mapping)
+	{
+		ring->handle = mapping;
+		ring->base = (char*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		MEMORY_BASIC_INFORMATION info;
+		if (ring->base && VirtualQuery(ring->base, &info, sizeof(info)))
+		{
+			regionBytes = info.RegionSize;
+		}
+	}
+#else
+	int file = shm_open(ring->name.c_str(), O_RDWR, 0);
+	struct stat status;
+	if (file >= 0 && fstat(file, &status) == 0 && (size_t)status.st_size >= RING_HEADER_BYTES)
+	{
+		regionBytes = (size_t)status.st_size;
+		// writable, since 64-bit atomic loads may be read-modify-writes on 32-bit targets
+		void* mapping = mmap(nullptr, regionBytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if (mapping != MAP_FAILED)
+		{
+			ring->base = (char*)mapping;
+		}
+	}
+	if (file >= 0)
+	{
+		close(file);
+	}
+#endif
+	if (!ring->base)
+	{
+		delete ring;
+		return nullptr;
+	}
+	ring->mappingBytes = regionBytes;
+
+	RingHeader* header = (RingHeader*)ring->base;
+	bool valid = memcmp(header->magic, RING_MAGIC, sizeof(header->magic)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	valid = valid && header->version == RING_VERSION && header->width > 0 && header->height > 0
+		&& (header->channels == 1 || header->channels == 3) && header->slotCount > 0
+		&& header->slotBytes >= RING_SLOT_HEADER_BYTES + (uint64_t)header->channels * header->width * header->height * sizeof(float)
+		&& RING_HEADER_BYTES + header->slotCount * header->slotBytes <= regionBytes;
+	if (!valid)
+	{
+		delete ring;
+		return nullptr;
+	}
+	ring->header = header;
+	return ring;
+}
+
+FrameRing::~FrameRing()
+{
+#ifdef _WIN32
+	if (base)
+	{
+		UnmapViewOfFile(base);
+	}
+	if (handle)
+	{
+		CloseHandle(handle);
+	}
+#else
+	if (base)
+	{
+		munmap(base, mappingBytes);
+	}
+	// consumers still attached keep their mapping, new ones can no longer attach
+	if (owner)
+	{
+		shm_unlink(name.c_str());
+	}
+#endif
+}
+
+RingSlotHeader& FrameRing::slot(uint64_t arg_frame) const
+{
+	return *(RingSlotHeader*)(base + RING_HEADER_BYTES + (arg_frame % header->slotCount) * header->slotBytes);
+}
+
+float* FrameRing::slotData(uint64_t arg_frame) const
+{
+	return (float*)((char*)&slot(arg_frame) + RING_SLOT_HEADER_BYTES);
+}
+
+uint64_t FrameRing::beginWrite()
+{
+	uint64_t frame = header->published.load(std::memory_order_relaxed);
+	RingSlotHeader& target = slot(frame);
+	uint32_t sequence = target.sequence.load(std::memory_order_relaxed);
+	target.sequence.store(sequence + 1, std::memory_order_relaxed);
+	// keeps the data writes from moving ahead of the odd sequence
+	std::atomic_thread_fence(std::memory_order_release);
+	return frame;
+}
+
+void FrameRing::endWrite(uint64_t arg_frame, uint64_t arg_step)
+{
+	RingSlotHeader& target = slot(arg_frame);
+	target.frame = arg_frame;
+	target.step = arg_step;
+	target.sequence.store(target.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	header->published.store(arg_frame + 1, std::memory_order_release);
+}
+
+void FrameRing::publish(uint64_t arg_step, const float* arg_density, const float* arg_veloX, const float* arg_veloY)
+{
+	uint64_t frame = beginWrite();
+	size_t planeBytes = (size_t)header->width * header->height * sizeof(float);
+	char* data = (char*)slotData(frame);
+	memcpy(data, arg_density, planeBytes);
+	if (header->channels == 3)
+	{
+		memcpy(data + planeBytes, arg_veloX, planeBytes);
+		memcpy(data + 2 * planeBytes, arg_veloY, planeBytes);
+	}
+	endWrite(frame, arg_step);
+}
+
+bool FrameRing::publish(const RuntimeSimulator& arg_simulator, uint64_t arg_step)
+{
+	// a larger grid would spill into the next slot, under a consumer's feet
+	if (arg_simulator.getWidth() != getWidth() || arg_simulator.getHeight() != getHeight())
+	{
+		return false;
+	}
+	uint64_t frame = beginWrite();
+	size_t cells = (size_t)header->width * header->height;
+	float* data = slotData(frame);
+	arg_simulator.readDensity(data);
+	if (header->channels == 3)
+	{
+		arg_simulator.readVelocity(data + cells, data + 2 * cells);
+	}
+	endWrite(frame, arg_step);
+	return true;
+}
+
+uint64_t FrameRing::getPublished() const
+{
+	return header->published.load(std::memory_order_acquire);
+}
+
+bool FrameRing::view(uint64_t arg_frame, FrameView& arg_view) const
+{
+	if (arg_frame >= getPublished())
+	{
+		return false;
+	}
+	RingSlotHeader& source = slot(arg_frame);
+	arg_view.sequence = source.sequence.load(std::memory_order_acquire);
+	if (arg_view.sequence & 1)
+	{
+		return false;
+	}
+	size_t cells = (size_t)header->width * header->height;
+	const float* data = slotData(arg_frame);
+	arg_view.density = data;
+	arg_view.velocityX = header->channels == 3 ? data + cells : nullptr;
+	arg_view.velocityY = header->channels == 3 ? data + 2 * cells : nullptr;
+	arg_view.frame = source.frame;
+	arg_view.step = source.step;
+	// the slot may already hold a later frame
+	return arg_view.frame == arg_frame && isIntact(arg_view);
+}
+
+bool FrameRing::isIntact(const FrameView& arg_view) const
+{
+	// orders the consumer's reads of the slot before the second look at its sequence
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot(arg_view.frame).sequence.load(std::memory_order_relaxed) == arg_view.sequence;
+}
+
+bool FrameRing::read(uint64_t arg_frame, float* arg_density, float* arg_veloX, float* arg_veloY, uint64_t* arg_step) const
+{
+	FrameView frame;
+	if (!view(arg_frame, frame))
+	{
+		return false;
+	}
+	size_t planeBytes = (size_t)header->width * header->height * sizeof(float);
+	if (arg_density)
+	{
+		memcpy(arg_density, frame.density, planeBytes);
+	}
+	if (arg_veloX && frame.velocityX)
+	{
+		memcpy(arg_veloX, frame.velocityX, planeBytes);
+	}
+	if (arg_veloY && frame.velocityY)
+	{
+		memcpy(arg_veloY, frame.velocityY, planeBytes);
+	}
+	if (arg_step)
+	{
+		*arg_step = frame.step;
+	}
+	return isIntact(frame);
+}
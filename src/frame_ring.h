@@ -0,0 +1,118 @@
+#pragma once
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+#include "runtime_simulator.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+class FrameRingConfig
+{
+public:
+	int width, height;
+	// also publish both velocity components after the density
+	bool withVelocity;
+	// frames kept, how far a consumer may lag before its frame is overwritten
+	int slots;
+	FrameRingConfig() : width(SIZE), height(SIZE), withVelocity(false), slots(4) {}
+};
+
+// Shared region layout:
+//   RingHeader, padded to RING_HEADER_BYTES
+//   slots of slotBytes each, a RingSlotHeader padded to RING_SLOT_HEADER_BYTES
+//   and then width * height floats of density and, with velocity, x and y
+// Frame f goes to slot f % slotCount. Each slot is guarded by a seqlock:
+// its sequence is odd while the simulator writes it, and a consumer that
+// sees the same even sequence before and after reading got a whole frame.
+static const uint32_t RING_VERSION = 1;
+static const size_t RING_HEADER_BYTES = 4096;
+static const size_t RING_SLOT_HEADER_BYTES = 64;
+
+class RingHeader
+{
+public:
+	char magic[8];
+	uint32_t version;
+	int32_t width, height;
+	uint32_t channels;
+	uint32_t slotCount;
+	uint64_t slotBytes;
+	// frames published so far; the latest is published - 1
+	std::atomic<uint64_t> published;
+};
+
+class RingSlotHeader
+{
+public:
+	std::atomic<uint32_t> sequence;
+	uint64_t frame;
+	// the simulator's step number
+	uint64_t step;
+};
+
+// Pointers straight into a slot; check FrameRing::isIntact() after using them
+class FrameView
+{
+public:
+	const float* density;
+	// nullptr without velocity
+	const float* velocityX;
+	const float* velocityY;
+	uint64_t frame, step;
+	uint32_t sequence;
+};
+
+// A ring of frames in named shared memory, written by the simulator each
+// step and read by any number of local processes without going through
+// files. The simulator never waits for consumers: one that falls more
+// than slots frames behind finds its frame overwritten and moves on.
+class FrameRing
+{
+public:
+	// the simulator's side: replaces any region of the same name, returns
+	// nullptr if it cannot be created
+	static FrameRing* Create(const char* arg_name, const FrameRingConfig& arg_config);
+	// a consumer's side: returns nullptr until the simulator has created the region
+	static FrameRing* Attach(const char* arg_name);
+	FrameRing(const FrameRing&) = delete;
+	FrameRing& operator=(const FrameRing&) = delete;
+	// unmaps, and the creator also removes the name
+	~FrameRing();
+
+	int getWidth() const { return header->width; }
+	int getHeight() const { return header->height; }
+	bool hasVelocity() const { return header->channels == 3; }
+	// row-major width * height arrays; the velocity ones are ignored without velocity
+	void publish(uint64_t arg_step, const float* arg_density, const float* arg_veloX, const float* arg_veloY);
+	// reads the simulator straight into the slot; false, publishing nothing,
+	// if its grid is not the ring's
+	bool publish(const RuntimeSimulator& arg_simulator, uint64_t arg_step);
+
+	// frames published so far
+	uint64_t getPublished() const;
+	// copies a frame out, any pointer may be nullptr; false if it is not
+	// published yet, or was overwritten while being read
+	bool read(uint64_t arg_frame, float* arg_density, float* arg_veloX, float* arg_veloY, uint64_t* arg_step) const;
+	// zero-copy access; false if the frame is not in the ring right now
+	bool view(uint64_t arg_frame, FrameView& arg_view) const;
+	// true if nothing has written the viewed slot since view()
+	bool isIntact(const FrameView& arg_view) const;
+
+private:
+	RingHeader* header;
+	char* base;
+	size_t mappingBytes;
+	std::string name;
+	bool owner;
+	// the file mapping object on Windows
+	void* handle;
+
+	FrameRing() : header(nullptr), base(nullptr), mappingBytes(0), owner(false), handle(nullptr) {}
+	RingSlotHeader& slot(uint64_t arg_frame) const;
+	float* slotData(uint64_t arg_frame) const;
+	// marks the next frame's slot as being written, returns its number
+	uint64_t beginWrite();
+	void endWrite(uint64_t arg_frame, uint64_t arg_step);
+};
+
+#endif
@@ -0,0 +1,664 @@
+#include "frame_server.h"
+#include "field_stream.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+// frames are far smaller than this even uncompressed, anything larger is a broken stream
+static const uint32_t MAX_MESSAGE_BYTES = 1u << 30;
+
+static bool SetNonBlocking(int arg_socket)
+{
+	int flags = fcntl(arg_socket, F_GETFL, 0);
+	return flags >= 0 && fcntl(arg_socket, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// small messages each way, so don't let Nagle hold them back
+static void SetNoDelay(int arg_socket)
+{
+	int enabled = 1;
+	setsockopt(arg_socket, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+}
+
+static bool UnixAddress(const std::string& arg_path, sockaddr_un& arg_address)
+{
+	if (arg_path.size() >= sizeof(arg_address.sun_path))
+	{
+		return false;
+	}
+	memset(&arg_address, 0, sizeof(arg_address));
+	arg_address.sun_family = AF_UNIX;
+	strcpy(arg_address.sun_path, arg_path.c_str());
+	return true;
+}
+
+static std::shared_ptr<std::vector<uint8_t>> NewMessage(MessageType arg_type, const void* arg_payload, uint32_t arg_bytes)
+{
+	std::shared_ptr<std::vector<uint8_t>> message = std::make_shared<std::vector<uint8_t>>(sizeof(MessageHeader) + arg_bytes);
+	MessageHeader header;
+	header.type = arg_type;
+	header.bytes = arg_bytes;
+	memcpy(message->data(), &header, sizeof(header));
+	memcpy(message->data() + sizeof(header), arg_payload, arg_bytes);
+	return message;
+}
+
+FrameServer* FrameServer::Create(const FrameServerConfig& arg_config, int arg_width, int arg_height)
+{
+	if (arg_width < 1 || arg_height < 1 || arg_config.maxClients < 1
+		|| (arg_config.bits != 8 && arg_config.bits != 12 && arg_config.bits != 16))
+	{
+		return nullptr;
+	}
+	int listener = -1;
+	int port = 0;
+	bool listening = false;
+	if (!arg_config.unixPath.empty())
+	{
+		sockaddr_un address;
+		if (UnixAddress(arg_config.unixPath, address))
+		{
+			unlink(address.sun_path);
+			listener = socket(AF_UNIX, SOCK_STREAM, 0);
+			listening = listener >= 0 && bind(listener, (sockaddr*)&address, sizeof(address)) == 0;
+		}
+	}
+	else
+	{
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+		int reuse = 1;
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(arg_config.loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+		address.sin_port = htons((uint16_t)arg_config.port);
+		socklen_t length = sizeof(address);
+		listening = listener >= 0 && setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == 0
+			&& bind(listener, (sockaddr*)&address, sizeof(address)) == 0
+			&& getsockname(listener, (sockaddr*)&address, &length) == 0;
+		port = ntohs(address.sin_port);
+	}
+	int wake[2] = { -1, -1 };
+	listening = listening && listen(listener, SOMAXCONN) == 0 && SetNonBlocking(listener)
+		&& pipe(wake) == 0 && SetNonBlocking(wake[0]) && SetNonBlocking(wake[1]);
+	if (!listening)
+	{
+		for (int handle : { listener, wake[0], wake[1] }) {
+			if (handle >= 0)
+			{
+				close(handle);
+			}
+		}
+		return nullptr;
+	}
+	return new FrameServer(arg_config, arg_width, arg_height, listener, port, wake[0], wake[1]);
+}
+
+FrameServer::FrameServer(const FrameServerConfig& arg_config, int arg_width, int arg_height, int arg_listener, int arg_port,
+	int arg_wakeRead, int arg_wakeWrite)
+	: config(arg_config), width(arg_width), height(arg_height), listener(arg_listener), port(arg_port),
+	wakeRead(arg_wakeRead), wakeWrite(arg_wakeWrite), stopping(false), clientCount(0), pendingStep(0), framePending(false)
+{
+	HelloMessage payload;
+	payload.version = SERVER_PROTOCOL_VERSION;
+	payload.width = width;
+	payload.height = height;
+	hello = NewMessage(MESSAGE_HELLO, &payload, sizeof(payload));
+	worker = std::thread(&FrameServer::run, this);
+}
+
+FrameServer::~FrameServer()
+{
+	stopping = true;
+	wake();
+	worker.join();
+	for (Client& client : clients) {
+		close(client.socket);
+	}
+	close(listener);
+	close(wakeRead);
+	close(wakeWrite);
+	if (!config.unixPath.empty())
+	{
+		unlink(config.unixPath.c_str());
+	}
+}
+
+void FrameServer::wake()
+{
+	// a full pipe already holds a wake-up, so a failed write loses nothing
+	char signal = 1;
+	ssize_t ignored = write(wakeWrite, &signal, 1);
+	(void)ignored;
+}
+
+void FrameServer::publish(uint64_t arg_step, const float* arg_density)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingFrame.assign(arg_density, arg_density + (size_t)width * height);
+		pendingStep = arg_step;
+		framePending = true;
+	}
+	wake();
+}
+
+bool FrameServer::publish(const RuntimeSimulator& arg_simulator, uint64_t arg_step)
+{
+	if (arg_simulator.getWidth() != width || arg_simulator.getHeight() != height)
+	{
+		return false;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingFrame.resize((size_t)width * height);
+		arg_simulator.readDensity(pendingFrame.data());
+		pendingStep = arg_step;
+		framePending = true;
+	}
+	wake();
+	return true;
+}
+
+bool FrameServer::pollCommand(ServerCommand& arg_command)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (commands.empty())
+	{
+		return false;
+	}
+	arg_command = commands.front();
+	commands.pop_front();
+	return true;
+}
+
+int FrameServer::applyCommands(RuntimeSimulator& arg_simulator)
+{
+	// positions were checked against the server's grid, not this simulator's
+	if (arg_simulator.getWidth() != width || arg_simulator.getHeight() != height)
+	{
+		return 0;
+	}
+	int applied = 0;
+	ServerCommand command;
+	while (pollCommand(command))
+	{
+		switch (command.type) {
+		case MESSAGE_ADD_DYE:
+			arg_simulator.addDye(command.dye.posX, command.dye.posY, command.dye.amount);
+			break;
+		case MESSAGE_ADD_VELOCITY:
+			arg_simulator.addVelocity(command.velocity.posX, command.velocity.posY, command.velocity.amountX, command.velocity.amountY);
+			break;
+		case MESSAGE_SET_PARAMETERS:
+			arg_simulator.setParameters(command.parameters.diffusion, command.parameters.viscocity, command.parameters.dt);
+			break;
+		case MESSAGE_SET_ITERATIONS:
+			arg_simulator.setIterations(command.iterations.iterations);
+			break;
+		default:
+			continue;
+		}
+		applied++;
+	}
+	return applied;
+}
+
+void FrameServer::run()
+{
+	std::vector<pollfd> sockets;
+	std::vector<bool> alive;
+	while (!stopping)
+	{
+		sockets.clear();
+		pollfd entry;
+		entry.fd = wakeRead;
+		entry.events = POLLIN;
+		sockets.push_back(entry);
+		entry.fd = listener;
+		sockets.push_back(entry);
+		for (const Client& client : clients) {
+			entry.fd = client.socket;
+			entry.events = POLLIN | (client.outgoing.empty() ? 0 : POLLOUT);
+			sockets.push_back(entry);
+		}
+		if (poll(sockets.data(), sockets.size(), -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			fprintf(stderr, "frame server stopped: %s\n", strerror(errno));
+			return;
+		}
+		if (sockets[0].revents & POLLIN)
+		{
+			char drain[64];
+			while (read(wakeRead, drain, sizeof(drain)) > 0)
+			{
+			}
+		}
+		if (stopping)
+		{
+			break;
+		}
+
+		broadcastFrame();
+		alive.assign(clients.size(), true);
+		for (size_t i = 0; i < clients.size(); i++) {
+			short events = sockets[i + 2].revents;
+			if (events & POLLIN)
+			{
+				alive[i] = receiveFrom(clients[i]);
+			}
+			if (events & (POLLERR | POLLHUP | POLLNVAL))
+			{
+				alive[i] = false;
+			}
+			// new frames go out straight away rather than after another poll
+			if (alive[i] && !clients[i].outgoing.empty())
+			{
+				alive[i] = sendTo(clients[i]);
+			}
+		}
+		for (size_t i = clients.size(); i-- > 0;) {
+			if (!alive[i])
+			{
+				close(clients[i].socket);
+				clients.erase(clients.begin() + i);
+			}
+		}
+		if (sockets[1].revents & POLLIN)
+		{
+			acceptClients();
+		}
+		clientCount = (int)clients.size();
+	}
+}
+
+void FrameServer::acceptClients()
+{
+	while (true)
+	{
+		int socket = accept(listener, nullptr, nullptr);
+		if (socket < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			// EAGAIN once the backlog is empty, anything else will show up again on the next poll
+			return;
+		}
+		if ((int)clients.size() >= config.maxClients || !SetNonBlocking(socket))
+		{
+			close(socket);
+			continue;
+		}
+		if (config.unixPath.empty())
+		{
+			SetNoDelay(socket);
+		}
+		Client client;
+		client.socket = socket;
+		client.sentBytes = 0;
+		client.queuedBytes = 0;
+		queueMessage(client, hello);
+		if (sendTo(client))
+		{
+			clients.push_back(std::move(client));
+		}
+		else
+		{
+			close(socket);
+		}
+	}
+}
+
+// Encoded once here for every client, off the simulation thread
+void FrameServer::broadcastFrame()
+{
+	uint64_t step;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!framePending)
+		{
+			return;
+		}
+		pendingFrame.swap(encodingFrame);
+		step = pendingStep;
+		framePending = false;
+	}
+	if (clients.empty())
+	{
+		return;
+	}
+	std::shared_ptr<std::vector<uint8_t>> message = std::make_shared<std::vector<uint8_t>>(sizeof(MessageHeader) + sizeof(step));
+	memcpy(message->data() + sizeof(MessageHeader), &step, sizeof(step));
+	EncodeField(encodingFrame.data(), encodingFrame.size(), config.bits, *message);
+	MessageHeader header;
+	header.type = MESSAGE_FRAME;
+	header.bytes = (uint32_t)(message->size() - sizeof(MessageHeader));
+	memcpy(message->data(), &header, sizeof(header));
+	for (Client& client : clients) {
+		if (client.queuedBytes <= config.maxQueuedBytes)
+		{
+			queueMessage(client, message);
+		}
+	}
+}
+
+void FrameServer::queueMessage(Client& arg_client, const std::shared_ptr<const std::vector<uint8_t>>& arg_message)
+{
+	arg_client.outgoing.push_back(arg_message);
+	arg_client.queuedBytes += arg_message->size();
+}
+
+bool FrameServer::sendTo(Client& arg_client)
+{
+	while (!arg_client.outgoing.empty())
+	{
+		const std::vector<uint8_t>& message = *arg_client.outgoing.front();
+		ssize_t sent = ::send(arg_client.socket, message.data() + arg_client.sentBytes, message.size() - arg_client.sentBytes, SEND_FLAGS);
+		if (sent < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		arg_client.sentBytes += sent;
+		if (arg_client.sentBytes == message.size())
+		{
+			arg_client.queuedBytes -= message.size();
+			arg_client.sentBytes = 0;
+			arg_client.outgoing.pop_front();
+		}
+	}
+	return true;
+}
+
+bool FrameServer::receiveFrom(Client& arg_client)
+{
+	uint8_t buffer[4096];
+	while (true)
+	{
+		ssize_t received = recv(arg_client.socket, buffer, sizeof(buffer), 0);
+		if (received > 0)
+		{
+			arg_client.received.insert(arg_client.received.end(), buffer, buffer + received);
+			continue;
+		}
+		if (received < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		// commands that arrived before the client hung up still count
+		bool open = received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+		return parseCommands(arg_client) && open;
+	}
+}
+
+// Commands that are well formed but out of range are dropped; anything
+// malformed disconnects the client, since the stream can't be resynchronized
+bool FrameServer::parseCommands(Client& arg_client)
+{
+	std::vector<ServerCommand> parsed;
+	const std::vector<uint8_t>& data = arg_client.received;
+	size_t offset = 0;
+	bool valid = true;
+	while (valid && data.size() - offset >= sizeof(MessageHeader))
+	{
+		MessageHeader header;
+		memcpy(&header, data.data() + offset, sizeof(header));
+		uint32_t expected = header.type == MESSAGE_ADD_DYE ? sizeof(DyeCommand)
+			: header.type == MESSAGE_ADD_VELOCITY ? sizeof(VelocityCommand)
+			: header.type == MESSAGE_SET_PARAMETERS ? sizeof(ParametersCommand)
+			: header.type == MESSAGE_SET_ITERATIONS ? sizeof(IterationsCommand) : 0;
+		if (expected == 0 || header.bytes != expected)
+		{
+			valid = false;
+			break;
+		}
+		if (data.size() - offset - sizeof(header) < expected)
+		{
+			break;
+		}
+		ServerCommand command;
+		command.type = (MessageType)header.type;
+		memcpy(&command.dye, data.data() + offset + sizeof(header), expected);
+		offset += sizeof(header) + expected;
+
+		bool accepted = false;
+		switch (command.type) {
+		case MESSAGE_ADD_DYE:
+			accepted = command.dye.posX >= 0 && command.dye.posX < width && command.dye.posY >= 0 && command.dye.posY < height
+				&& std::isfinite(command.dye.amount);
+			break;
+		case MESSAGE_ADD_VELOCITY:
+			accepted = command.velocity.posX >= 0 && command.velocity.posX < width && command.velocity.posY >= 0
+				&& command.velocity.posY < height && std::isfinite(command.velocity.amountX) && std::isfinite(command.velocity.amountY);
+			break;
+		case MESSAGE_SET_PARAMETERS:
+			accepted = command.parameters.diffusion >= 0.0f && command.parameters.viscocity >= 0.0f && command.parameters.dt > 0.0f
+				&& std::isfinite(command.parameters.diffusion) && std::isfinite(command.parameters.viscocity) && std::isfinite(command.parameters.dt);
+			break;
+		case MESSAGE_SET_ITERATIONS:
+			accepted = command.iterations.iterations > 0;
+			break;
+		default:
+			break;
+		}
+		if (accepted)
+		{
+			parsed.push_back(command);
+		}
+	}
+	arg_client.received.erase(arg_client.received.begin(), arg_client.received.begin() + offset);
+	if (!parsed.empty())
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		commands.insert(commands.end(), parsed.begin(), parsed.end());
+	}
+	return valid;
+}
+
+static bool SendAll(int arg_socket, const uint8_t* arg_data, size_t arg_bytes)
+{
+	while (arg_bytes > 0)
+	{
+		ssize_t sent = ::send(arg_socket, arg_data, arg_bytes, SEND_FLAGS);
+		if (sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (sent <= 0)
+		{
+			return false;
+		}
+		arg_data += sent;
+		arg_bytes -= sent;
+	}
+	return true;
+}
+
+static bool ReceiveAll(int arg_socket, void* arg_data, size_t arg_bytes)
+{
+	char* data = (char*)arg_data;
+	while (arg_bytes > 0)
+	{
+		ssize_t received = recv(arg_socket, data, arg_bytes, 0);
+		if (received < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (received <= 0)
+		{
+			return false;
+		}
+		data += received;
+		arg_bytes -= received;
+	}
+	return true;
+}
+
+FrameClient* FrameClient::Connect(const std::string& arg_address)
+{
+	int socket = -1;
+	size_t colon = arg_address.rfind(':');
+	if (colon != std::string::npos && arg_address[0] != '/')
+	{
+		std::string host = arg_address.substr(0, colon);
+		std::string service = arg_address.substr(colon + 1);
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		addrinfo* results = nullptr;
+		if (getaddrinfo(host.c_str(), service.c_str(), &hints, &results) == 0)
+		{
+			for (addrinfo* candidate = results; candidate && socket < 0; candidate = candidate->ai_next) {
+				socket = ::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+				if (socket >= 0 && connect(socket, candidate->ai_addr, candidate->ai_addrlen) != 0)
+				{
+					close(socket);
+					socket = -1;
+				}
+			}
+			freeaddrinfo(results);
+		}
+		if (socket >= 0)
+		{
+			SetNoDelay(socket);
+		}
+	}
+	else
+	{
+		sockaddr_un address;
+		if (UnixAddress(arg_address, address))
+		{
+			socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+			if (socket >= 0 && connect(socket, (sockaddr*)&address, sizeof(address)) != 0)
+			{
+				close(socket);
+				socket = -1;
+			}
+		}
+	}
+	if (socket < 0)
+	{
+		return nullptr;
+	}
+
+	FrameClient* client = new FrameClient(socket);
+	MessageHeader header;
+	HelloMessage hello;
+	bool greeted = client->receive(header) && header.type == MESSAGE_HELLO && header.bytes == sizeof(hello);
+	if (greeted)
+	{
+		memcpy(&hello, client->message.data(), sizeof(hello));
+		greeted = hello.version == SERVER_PROTOCOL_VERSION && hello.width > 0 && hello.height > 0;
+	}
+	if (!greeted)
+	{
+		delete client;
+		return nullptr;
+	}
+	client->width = hello.width;
+	client->height = hello.height;
+	return client;
+}
+
+FrameClient::~FrameClient()
+{
+	close(socket);
+}
+
+bool FrameClient::send(MessageType arg_type, const void* arg_payload, uint32_t arg_bytes)
+{
+	std::shared_ptr<std::vector<uint8_t>> message = NewMessage(arg_type, arg_payload, arg_bytes);
+	return SendAll(socket, message->data(), message->size());
+}
+
+bool FrameClient::receive(MessageHeader& arg_header)
+{
+	if (!ReceiveAll(socket, &arg_header, sizeof(arg_header)) || arg_header.bytes > MAX_MESSAGE_BYTES)
+	{
+		return false;
+	}
+	message.resize(arg_header.bytes);
+	return ReceiveAll(socket, message.data(), message.size());
+}
+
+bool FrameClient::receiveFrame(uint64_t& arg_step, float* arg_density)
+{
+	MessageHeader header;
+	while (receive(header))
+	{
+		if (header.type != MESSAGE_FRAME)
+		{
+			continue;
+		}
+		if (header.bytes < sizeof(arg_step))
+		{
+			return false;
+		}
+		memcpy(&arg_step, message.data(), sizeof(arg_step));
+		return DecodeField(message.data() + sizeof(arg_step), message.size() - sizeof(arg_step), (size_t)width * height, arg_density);
+	}
+	return false;
+}
+
+bool FrameClient::addDye(int arg_posX, int arg_posY, float arg_amount)
+{
+	DyeCommand command;
+	command.posX = arg_posX;
+	command.posY = arg_posY;
+	command.amount = arg_amount;
+	return send(MESSAGE_ADD_DYE, &command, sizeof(command));
+}
+
+bool FrameClient::addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY)
+{
+	VelocityCommand command;
+	command.posX = arg_posX;
+	command.posY = arg_posY;
+	command.amountX = arg_amountX;
+	command.amountY = arg_amountY;
+	return send(MESSAGE_ADD_VELOCITY, &command, sizeof(command));
+}
+
+bool FrameClient::setParameters(float arg_diffusion, float arg_viscocity, float arg_dt)
+{
+	ParametersCommand command;
+	command.diffusion = arg_diffusion;
+	command.viscocity = arg_viscocity;
+	command.dt = arg_dt;
+	return send(MESSAGE_SET_PARAMETERS, &command, sizeof(command));
+}
+
+bool FrameClient::setIterations(int arg_iterations)
+{
+	IterationsCommand command;
+	command.iterations = arg_iterations;
+	return send(MESSAGE_SET_ITERATIONS, &command, sizeof(command));
+}
+
+#endif
@@ -0,0 +1,201 @@
+#pragma once
+#ifndef FRAME_SERVER_H
+#define FRAME_SERVER_H
+#include "runtime_simulator.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Wire protocol, little endian. Every message is a MessageHeader followed
+// by bytes of payload. The server greets each client with MESSAGE_HELLO,
+// then sends MESSAGE_FRAME as the simulation publishes: a uint64_t step
+// and an EncodeField block of the density. Clients send the command
+// messages, each payload being the matching command class.
+static const uint32_t SERVER_PROTOCOL_VERSION = 1;
+
+enum MessageType
+{
+	MESSAGE_HELLO = 1, MESSAGE_FRAME, MESSAGE_ADD_DYE, MESSAGE_ADD_VELOCITY, MESSAGE_SET_PARAMETERS, MESSAGE_SET_ITERATIONS
+};
+
+class MessageHeader
+{
+public:
+	uint32_t type;
+	uint32_t bytes;
+};
+
+class HelloMessage
+{
+public:
+	uint32_t version;
+	int32_t width, height;
+};
+
+class DyeCommand
+{
+public:
+	int32_t posX, posY;
+	float amount;
+};
+
+class VelocityCommand
+{
+public:
+	int32_t posX, posY;
+	float amountX, amountY;
+};
+
+class ParametersCommand
+{
+public:
+	float diffusion, viscocity, dt;
+};
+
+class IterationsCommand
+{
+public:
+	int32_t iterations;
+};
+
+// A validated command from a client, for the simulation thread to apply
+class ServerCommand
+{
+public:
+	MessageType type;
+	union
+	{
+		DyeCommand dye;
+		VelocityCommand velocity;
+		ParametersCommand parameters;
+		IterationsCommand iterations;
+	};
+};
+
+class FrameServerConfig
+{
+public:
+	// listen on this Unix socket path, or on TCP port when empty
+	std::string unixPath;
+	// 0 picks a free port, see FrameServer::getPort()
+	int port;
+	// TCP only: accept connections from this machine alone
+	bool loopbackOnly;
+	// code width of the frames, 8, 12 or 16
+	int bits;
+	int maxClients;
+	// frames are skipped for a client with more than this many bytes unsent
+	size_t maxQueuedBytes;
+	FrameServerConfig()
+		: port(7401), loopbackOnly(true), bits(8), maxClients(16), maxQueuedBytes(4 << 20) {}
+};
+
+#ifndef _WIN32
+
+// Streams density frames to any number of clients and collects their
+// commands, all on one thread driving non-blocking sockets with poll().
+// publish() only hands over the frame: the server thread compresses it
+// once and queues it for every client. If the server thread is still busy,
+// the newer frame replaces the pending one. A slow client misses frames
+// rather than holding up the rest. POSIX only.
+class FrameServer
+{
+public:
+	// returns nullptr if the socket cannot be set up
+	static FrameServer* Create(const FrameServerConfig& arg_config, int arg_width, int arg_height);
+	FrameServer(const FrameServer&) = delete;
+	FrameServer& operator=(const FrameServer&) = delete;
+	// disconnects every client and stops the server thread
+	~FrameServer();
+	// row-major width * height density
+	void publish(uint64_t arg_step, const float* arg_density);
+	// false, publishing nothing, if the simulator's grid is not the server's
+	bool publish(const RuntimeSimulator& arg_simulator, uint64_t arg_step);
+	// takes the oldest command received, false if there is none
+	bool pollCommand(ServerCommand& arg_command);
+	// applies every command received so far, returns how many; a simulator
+	// whose grid is not the server's gets none and they stay queued
+	int applyCommands(RuntimeSimulator& arg_simulator);
+	// the TCP port actually bound, 0 for a Unix socket
+	int getPort() const { return port; }
+	int getClientCount() const { return clientCount.load(); }
+
+private:
+	class Client
+	{
+	public:
+		int socket;
+		std::vector<uint8_t> received;
+		// messages still to send, the first partly sent up to sentBytes
+		std::deque<std::shared_ptr<const std::vector<uint8_t>>> outgoing;
+		size_t sentBytes, queuedBytes;
+	};
+
+	FrameServerConfig config;
+	int width, height;
+	int listener;
+	int port;
+	// written by publish() to interrupt poll()
+	int wakeRead, wakeWrite;
+	std::atomic<bool> stopping;
+	std::atomic<int> clientCount;
+	std::thread worker;
+	std::vector<Client> clients;
+	std::shared_ptr<const std::vector<uint8_t>> hello;
+
+	// handed over from the simulation thread
+	std::mutex mutex;
+	std::vector<float> pendingFrame, encodingFrame;
+	uint64_t pendingStep;
+	bool framePending;
+	std::deque<ServerCommand> commands;
+
+	FrameServer(const FrameServerConfig& arg_config, int arg_width, int arg_height, int arg_listener, int arg_port, int arg_wakeRead, int arg_wakeWrite);
+	void wake();
+	void run();
+	void acceptClients();
+	void broadcastFrame();
+	void queueMessage(Client& arg_client, const std::shared_ptr<const std::vector<uint8_t>>& arg_message);
+	// false once the client should be dropped
+	bool receiveFrom(Client& arg_client);
+	bool sendTo(Client& arg_client);
+	bool parseCommands(Client& arg_client);
+};
+
+// Blocking counterpart for viewers, controllers and tests
+class FrameClient
+{
+public:
+	// "host:port" or a Unix socket path; returns nullptr if the connection or handshake fails
+	static FrameClient* Connect(const std::string& arg_address);
+	FrameClient(const FrameClient&) = delete;
+	FrameClient& operator=(const FrameClient&) = delete;
+	~FrameClient();
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	// waits for the next frame into a width * height array, false once the server is gone
+	bool receiveFrame(uint64_t& arg_step, float* arg_density);
+	bool addDye(int arg_posX, int arg_posY, float arg_amount);
+	bool addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY);
+	bool setParameters(float arg_diffusion, float arg_viscocity, float arg_dt);
+	bool setIterations(int arg_iterations);
+
+private:
+	int socket;
+	int width, height;
+	std::vector<uint8_t> message;
+
+	FrameClient(int arg_socket) : socket(arg_socket), width(0), height(0) {}
+	bool send(MessageType arg_type, const void* arg_payload, uint32_t arg_bytes);
+	// the next message's payload into message
+	bool receive(MessageHeader& arg_header);
+};
+
+#endif
+
+#endif
@@ -1,8 +1,11 @@
 #version 150
 
-in float alphaVal;
+// rows of the density run along the screen's x axis, hence the swizzle
+uniform sampler2D density;
+
+in vec2 texCoord;
 out vec4 fColor;
 
 void main() {
-    fColor = vec4(0.5,0.0,1.0,alphaVal); 
+    fColor = vec4(0.5,0.0,1.0,clamp(texture(density, texCoord.yx).r, 0.0, 0.99)); 
 }
\ No newline at end of file
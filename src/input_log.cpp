@@ -0,0 +1,310 @@
+#include "input_log.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+static const char INPUT_MAGIC[8] = { 'F', 'L', 'U', 'I', 'D', 'I', 'N', 0 };
+static const uint32_t INPUT_VERSION = 1;
+
+static void PutVarint(std::vector<uint8_t>& arg_out, uint32_t arg_value)
+{
+	while (arg_value >= 0x80)
+	{
+		arg_out.push_back((uint8_t)(arg_value | 0x80));
+		arg_value >>= 7;
+	}
+	arg_out.push_back((uint8_t)arg_value);
+}
+
+static void PutFloat(std::vector<uint8_t>& arg_out, float arg_value)
+{
+	uint8_t bytes[sizeof(float)];
+	memcpy(bytes, &arg_value, sizeof(bytes));
+	arg_out.insert(arg_out.end(), bytes, bytes + sizeof(bytes));
+}
+
+static bool GetVarint(const std::vector<uint8_t>& arg_in, size_t& arg_pos, uint32_t& arg_value)
+{
+	arg_value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (arg_pos >= arg_in.size())
+		{
+			return false;
+		}
+		uint8_t next = arg_in[arg_pos++];
+		arg_value |= (uint32_t)(next & 0x7f) << shift;
+		if (!(next & 0x80))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool GetFloat(const std::vector<uint8_t>& arg_in, size_t& arg_pos, float& arg_value)
+{
+	if (arg_in.size() - arg_pos < sizeof(float))
+	{
+		return false;
+	}
+	memcpy(&arg_value, arg_in.data() + arg_pos, sizeof(float));
+	arg_pos += sizeof(float);
+	return true;
+}
+
+InputRecorder* InputRecorder::Create(const char* arg_path, const SimulatorConfig& arg_config)
+{
+	FILE* file = fopen(arg_path, "wb");
+	if (!file)
+	{
+		return nullptr;
+	}
+	InputLogHeader header = {};
+	memcpy(header.magic, INPUT_MAGIC, sizeof(header.magic));
+	header.version = INPUT_VERSION;
+	header.width = arg_config.width;
+	header.height = arg_config.height;
+	header.iterations = arg_config.iterations;
+	header.cellSizeX = arg_config.cellSizeX;
+	header.cellSizeY = arg_config.cellSizeY;
+	header.diffusion = arg_config.diffusion;
+	header.viscocity = arg_config.viscocity;
+	header.dt = arg_config.dt;
+	header.solver = arg_config.solver;
+	header.advector = arg_config.advector;
+	header.boundary = arg_config.boundary;
+	header.layout = arg_config.layout;
+	header.precision = arg_config.precision;
+	header.trackActivity = arg_config.trackActivity;
+	header.cfl = arg_config.cfl;
+	header.maxSubsteps = arg_config.maxSubsteps;
+	InputRecorder* recorder = new InputRecorder(file);
+	recorder->failed = fwrite(&header, sizeof(header), 1, file) != 1;
+	return recorder;
+}
+
+InputRecorder::~InputRecorder()
+{
+	close();
+}
+
+void InputRecorder::begin(InputEventKind arg_kind)
+{
+	event.clear();
+	event.push_back((uint8_t)arg_kind);
+	PutVarint(event, frame - lastFrame);
+	lastFrame = frame;
+}
+
+void InputRecorder::writeEvent()
+{
+	if (file && fwrite(event.data(), 1, event.size(), file) != event.size())
+	{
+		failed = true;
+	}
+}
+
+void InputRecorder::addDye(int arg_posX, int arg_posY, float arg_amount)
+{
+	begin(INPUT_DYE);
+	PutVarint(event, arg_posX);
+	PutVarint(event, arg_posY);
+	PutFloat(event, arg_amount);
+	writeEvent();
+}
+
+void InputRecorder::addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY)
+{
+	begin(INPUT_VELOCITY);
+	PutVarint(event, arg_posX);
+	PutVarint(event, arg_posY);
+	PutFloat(event, arg_amountX);
+	PutFloat(event, arg_amountY);
+	writeEvent();
+}
+
+void InputRecorder::fadeDensity(float arg_amount)
+{
+	begin(INPUT_FADE);
+	PutFloat(event, arg_amount);
+	writeEvent();
+}
+
+void InputRecorder::setLevel(int arg_level)
+{
+	begin(INPUT_LEVEL);
+	PutVarint(event, arg_level);
+	writeEvent();
+}
+
+bool InputRecorder::close()
+{
+	if (!file)
+	{
+		return !failed;
+	}
+	begin(INPUT_END);
+	writeEvent();
+	if (fclose(file) != 0)
+	{
+		failed = true;
+	}
+	file = nullptr;
+	return !failed;
+}
+
+InputReplay* InputReplay::Open(const char* arg_path)
+{
+	FILE* file = fopen(arg_path, "rb");
+	if (!file)
+	{
+		return nullptr;
+	}
+	InputLogHeader header;
+	// the kinds are range checked before they are cast to their enums
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, INPUT_MAGIC, sizeof(header.magic)) == 0
+		&& header.version == INPUT_VERSION && header.width > 2 && header.height > 2
+		&& header.iterations > 0 && header.dt > 0.0f && std::isfinite(header.dt)
+		&& header.cfl > 0.0f && std::isfinite(header.cfl) && header.maxSubsteps > 0
+		&& header.solver <= SOLVER_RED_BLACK && header.advector <= ADVECTOR_NEAREST && header.boundary <= BOUNDARY_PERIODIC
+		&& header.layout <= LAYOUT_MORTON && header.precision <= PRECISION_BFLOAT16;
+	std::vector<uint8_t> data;
+	uint8_t buffer[4096];
+	size_t count;
+	while (valid && (count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		data.insert(data.end(), buffer, buffer + count);
+	}
+	fclose(file);
+	if (!valid)
+	{
+		return nullptr;
+	}
+
+	InputReplay* replay = new InputReplay();
+	SimulatorConfig& config = replay->config;
+	config.width = header.width;
+	config.height = header.height;
+	config.iterations = header.iterations;
+	config.cellSizeX = header.cellSizeX;
+	config.cellSizeY = header.cellSizeY;
+	config.diffusion = header.diffusion;
+	config.viscocity = header.viscocity;
+	config.dt = header.dt;
+	config.solver = (SolverKind)header.solver;
+	config.advector = (AdvectorKind)header.advector;
+	config.boundary = (BoundaryKind)header.boundary;
+	config.layout = (LayoutKind)header.layout;
+	config.precision = (PrecisionKind)header.precision;
+	config.trackActivity = header.trackActivity != 0;
+	config.cfl = header.cfl;
+	config.maxSubsteps = header.maxSubsteps;
+	if (!RuntimeSimulator::IsSupported(config))
+	{
+		delete replay;
+		return nullptr;
+	}
+
+	size_t pos = 0;
+	uint32_t frame = 0;
+	bool ended = false;
+	while (valid && !ended && pos < data.size())
+	{
+		InputEvent event = {};
+		event.kind = (InputEventKind)data[pos++];
+		uint32_t delta, posX = 0, posY = 0;
+		valid = GetVarint(data, pos, delta);
+		frame += delta;
+		event.frame = frame;
+		switch (event.kind) {
+		case INPUT_DYE:
+			valid = valid && GetVarint(data, pos, posX) && GetVarint(data, pos, posY) && GetFloat(data, pos, event.amountX);
+			break;
+		case INPUT_VELOCITY:
+			valid = valid && GetVarint(data, pos, posX) && GetVarint(data, pos, posY)
+				&& GetFloat(data, pos, event.amountX) && GetFloat(data, pos, event.amountY);
+			break;
+		case INPUT_FADE:
+			valid = valid && GetFloat(data, pos, event.amountX);
+			break;
+		case INPUT_LEVEL:
+			valid = valid && GetVarint(data, pos, posX);
+			break;
+		case INPUT_END:
+			ended = valid;
+			break;
+		default:
+			valid = false;
+			break;
+		}
+		if ((event.kind == INPUT_DYE || event.kind == INPUT_VELOCITY) && (posX >= (uint32_t)header.width || posY >= (uint32_t)header.height))
+		{
+			valid = false;
+		}
+		event.posX = posX;
+		event.posY = posY;
+		if (valid && !ended)
+		{
+			replay->events.push_back(event);
+		}
+	}
+	// a damaged tail after whole events is treated like a missing end marker
+	replay->frameCount = ended ? frame : replay->events.empty() ? 0 : replay->events.back().frame + 1;
+	return replay;
+}
+
+void InputReplay::applyFrame(int arg_frame, QualityController& arg_target)
+{
+	while (cursor < events.size() && events[cursor].frame < (uint32_t)arg_frame)
+	{
+		cursor++;
+	}
+	for (; cursor < events.size() && events[cursor].frame == (uint32_t)arg_frame; cursor++) {
+		const InputEvent& event = events[cursor];
+		switch (event.kind) {
+		case INPUT_DYE:
+			arg_target.addDye(event.posX, event.posY, event.amountX);
+			break;
+		case INPUT_VELOCITY:
+			arg_target.addVelocity(event.posX, event.posY, event.amountX, event.amountY);
+			break;
+		case INPUT_FADE:
+			arg_target.fadeDensity(event.amountX);
+			break;
+		case INPUT_LEVEL:
+			if (event.posX >= 0 && event.posX < arg_target.getLevelCount() && event.posX != arg_target.getLevel())
+			{
+				arg_target.setLevel(event.posX);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+ReplayResult ReplayHeadless(InputReplay& arg_replay, double arg_budgetMs)
+{
+	const SimulatorConfig& config = arg_replay.getConfig();
+	QualityController controller(config, arg_budgetMs);
+	controller.adaptive = false;
+	ReplayResult result;
+	result.frames = arg_replay.getFrameCount();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < result.frames; frame++) {
+		arg_replay.applyFrame(frame, controller);
+		controller.advance(config.dt);
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	result.msPerFrame = result.frames > 0 ? ms / result.frames : 0.0;
+
+	std::vector<float> density((size_t)config.width * config.height);
+	controller.readDensity(density.data());
+	uint64_t hash = 14695981039346656037ull;
+	const uint8_t* bytes = (const uint8_t*)density.data();
+	for (size_t i = 0; i < density.size() * sizeof(float); i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	result.densityHash = hash;
+	return result;
+}
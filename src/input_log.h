@@ -0,0 +1,107 @@
+#pragma once
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+#include "quality.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+enum InputEventKind { INPUT_DYE = 1, INPUT_VELOCITY, INPUT_FADE, INPUT_LEVEL, INPUT_END };
+
+// Input log layout, little endian:
+//   InputLogHeader, holding the config the session ran with
+//   events, each a kind byte, the frame as a varint delta from the previous
+//   event and the kind's payload: varint positions or level, raw floats
+//   INPUT_END carrying the number of frames
+// Events of frame f were injected before frame f was advanced. Floats are
+// stored bit for bit, so a replay injects exactly what was recorded.
+class InputLogHeader
+{
+public:
+	char magic[8];
+	uint32_t version;
+	int32_t width, height, iterations;
+	float cellSizeX, cellSizeY;
+	float diffusion, viscocity, dt;
+	uint32_t solver, advector, boundary, layout, precision, trackActivity;
+	float cfl;
+	int32_t maxSubsteps;
+};
+
+class InputEvent
+{
+public:
+	InputEventKind kind;
+	uint32_t frame;
+	// the position, or the level for INPUT_LEVEL
+	int32_t posX, posY;
+	// the dye or fade amount, or the velocity
+	float amountX, amountY;
+};
+
+// Writes every injection of an interactive session, and the quality level
+// switches that change how later injections land
+class InputRecorder
+{
+public:
+	// returns nullptr if the file cannot be created
+	static InputRecorder* Create(const char* arg_path, const SimulatorConfig& arg_config);
+	InputRecorder(const InputRecorder&) = delete;
+	InputRecorder& operator=(const InputRecorder&) = delete;
+	~InputRecorder();
+	void addDye(int arg_posX, int arg_posY, float arg_amount);
+	void addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY);
+	void fadeDensity(float arg_amount);
+	void setLevel(int arg_level);
+	// call once the current frame has been advanced
+	void nextFrame() { frame++; }
+	// writes the end marker, returns false if any write failed
+	bool close();
+
+private:
+	FILE* file;
+	uint32_t frame, lastFrame;
+	bool failed;
+	std::vector<uint8_t> event;
+
+	InputRecorder(FILE* arg_file) : file(arg_file), frame(0), lastFrame(0), failed(false) {}
+	void begin(InputEventKind arg_kind);
+	void writeEvent();
+};
+
+// A recorded session, loaded whole
+class InputReplay
+{
+public:
+	// returns nullptr if the file is missing or damaged, including a header
+	// whose config RuntimeSimulator cannot build or step; a log cut short
+	// before its end marker replays up to its last event
+	static InputReplay* Open(const char* arg_path);
+	const SimulatorConfig& getConfig() const { return config; }
+	int getFrameCount() const { return frameCount; }
+	// injects the events of arg_frame in recorded order; frames must be applied in order
+	void applyFrame(int arg_frame, QualityController& arg_target);
+
+private:
+	SimulatorConfig config;
+	std::vector<InputEvent> events;
+	int frameCount;
+	size_t cursor;
+
+	InputReplay() : frameCount(0), cursor(0) {}
+};
+
+class ReplayResult
+{
+public:
+	int frames;
+	double msPerFrame;
+	// FNV-1a of the final density bits, equal across runs of the same log and build
+	uint64_t densityHash;
+};
+
+// Replays a session without a window, with the quality level following the
+// log instead of the clock
+ReplayResult ReplayHeadless(InputReplay& arg_replay, double arg_budgetMs);
+
+#endif
@@ -0,0 +1,182 @@
+#pragma once
+#ifndef LAYOUT_H
+#define LAYOUT_H
+// pdep is BMI2, which AVX2 does not imply; MSVC defines no BMI2 macro, so
+// its builds take the portable bit spread
+#if defined(__BMI2__)
+#  include <immintrin.h>
+#  define LAYOUT_HAS_PDEP
+#endif
+
+// Layout policies map a cell (x, y) to its offset inside a field plane.
+// FluidCell sizes its planes from storageSize() and the simulator kernels
+// only ever address cells through GenerateIndex(), so a kernel is written
+// once and compiled for every layout. Constructors take the size of one
+// stored value, which layouts that pad for the cache need.
+
+constexpr int Log2(int arg_value)
+{
+	return arg_value <= 1 ? 0 : 1 + Log2(arg_value / 2);
+}
+
+// Plain row-major addressing. Rows are pitch values apart rather than
+// width: whole cache lines, plus one more line when a row would be a
+// multiple of 256 bytes, so the (x, y +- 1) stencil neighbours no longer
+// map to the same cache sets.
+class RowMajorLayout
+{
+public:
+	int width, height;
+	int pitch;
+	RowMajorLayout(int arg_width, int arg_height, int arg_elementBytes, int arg_pitch = 0) : width(arg_width), height(arg_height)
+	{
+		pitch = arg_pitch > 0 ? arg_pitch : ChoosePitch(arg_width, arg_elementBytes);
+	}
+	inline int GenerateIndex(int arg_x, int arg_y) const
+	{
+		return arg_x + arg_y * pitch;
+	}
+	int storageSize() const { return pitch * height; }
+
+	static int ChoosePitch(int arg_width, int arg_elementBytes)
+	{
+		const int lineValues = 64 / arg_elementBytes;
+		int pitch = (arg_width + lineValues - 1) / lineValues * lineValues;
+		if ((pitch * arg_elementBytes) % 256 == 0)
+		{
+			pitch += lineValues;
+		}
+		return pitch;
+	}
+};
+
+// The grid is cut into TILE x TILE blocks stored contiguously, blocks in
+// row-major order, so the vertical stencil neighbours of a cell usually sit
+// TILE floats away instead of a whole row away
+template <int TILE>
+class TiledLayout
+{
+	static_assert(TILE > 0 && (TILE & (TILE - 1)) == 0, "tile size must be a power of two");
+	static const int TILE_SHIFT = Log2(TILE);
+	static const int TILE_MASK = TILE - 1;
+public:
+	int width, height;
+	int tilesX, tilesY;
+	TiledLayout(int arg_width, int arg_height, int) : width(arg_width), height(arg_height)
+	{
+		tilesX = (arg_width + TILE_MASK) >> TILE_SHIFT;
+		tilesY = (arg_height + TILE_MASK) >> TILE_SHIFT;
+	}
+	inline int GenerateIndex(int arg_x, int arg_y) const
+	{
+		int tile = (arg_x >> TILE_SHIFT) + (arg_y >> TILE_SHIFT) * tilesX;
+		return (tile << (2 * TILE_SHIFT)) + (arg_x & TILE_MASK) + ((arg_y & TILE_MASK) << TILE_SHIFT);
+	}
+	int storageSize() const { return tilesX * tilesY * TILE * TILE; }
+};
+
+// Cells are stored along a Z-order (Morton) curve: the bits of x and y are
+// interleaved, so any 2D neighbourhood stays within a few cache lines and
+// pages no matter which axis a backtrace travels along. Each axis is padded
+// to its own power of two. The low bits shared by both axes are
+// interleaved, and the longer axis's remaining bits pick one of a row of
+// square Morton blocks, so a 4:1 grid needs no more storage than its
+// padded extents. Coordinates are limited to 16 bits.
+class MortonLayout
+{
+public:
+	int width, height;
+	int sideX, sideY;
+	// bits of each coordinate that are interleaved, log2 of the shorter side
+	int sharedBits;
+	MortonLayout(int arg_width, int arg_height, int) : width(arg_width), height(arg_height)
+	{
+		sideX = 1;
+		while (sideX < arg_width)
+		{
+			sideX <<= 1;
+		}
+		sideY = 1;
+		while (sideY < arg_height)
+		{
+			sideY <<= 1;
+		}
+		sharedBits = Log2(sideX < sideY ? sideX : sideY);
+	}
+	inline int GenerateIndex(int arg_x, int arg_y) const
+	{
+		unsigned int mask = (1u << sharedBits) - 1;
+		unsigned int block = ((unsigned int)arg_x | (unsigned int)arg_y) >> sharedBits;
+		return (int)(SpreadBits((unsigned int)arg_x & mask) | (SpreadBits((unsigned int)arg_y & mask) << 1) | (block << (2 * sharedBits)));
+	}
+	int storageSize() const { return sideX * sideY; }
+
+	// moves bit k of arg_value to bit 2k, with BMI2 this is a single pdep
+	static inline unsigned int SpreadBits(unsigned int arg_value)
+	{
+#ifdef LAYOUT_HAS_PDEP
+		return _pdep_u32(arg_value, 0x55555555u);
+#else
+		arg_value &= 0x0000ffffu;
+		arg_value = (arg_value | (arg_value << 8)) & 0x00ff00ffu;
+		arg_value = (arg_value | (arg_value << 4)) & 0x0f0f0f0fu;
+		arg_value = (arg_value | (arg_value << 2)) & 0x33333333u;
+		arg_value = (arg_value | (arg_value << 1)) & 0x55555555u;
+		return arg_value;
+#endif
+	}
+};
+
+// 3D layouts follow the same contract with a third coordinate
+
+// Row-major volume: x fastest, then rows, then slices. Rows get the same
+// cache line padding as RowMajorLayout and slices are padded by one row
+// when they would otherwise be a multiple of 4 KB apart.
+class RowMajorLayout3D
+{
+public:
+	int width, height, depth;
+	int pitch, slicePitch;
+	RowMajorLayout3D(int arg_width, int arg_height, int arg_depth, int arg_elementBytes) : width(arg_width), height(arg_height), depth(arg_depth)
+	{
+		pitch = RowMajorLayout::ChoosePitch(arg_width, arg_elementBytes);
+		slicePitch = pitch * arg_height;
+		if ((slicePitch * arg_elementBytes) % 4096 == 0)
+		{
+			slicePitch += pitch;
+		}
+	}
+	inline int GenerateIndex(int arg_x, int arg_y, int arg_z) const
+	{
+		return arg_x + arg_y * pitch + arg_z * slicePitch;
+	}
+	int storageSize() const { return slicePitch * depth; }
+};
+
+// The volume is cut into BRICK^3 blocks stored contiguously, so all six
+// neighbours of most cells are within one brick
+template <int BRICK>
+class TiledLayout3D
+{
+	static_assert(BRICK > 0 && (BRICK & (BRICK - 1)) == 0, "brick size must be a power of two");
+	static const int BRICK_SHIFT = Log2(BRICK);
+	static const int BRICK_MASK = BRICK - 1;
+public:
+	int width, height, depth;
+	int bricksX, bricksY, bricksZ;
+	TiledLayout3D(int arg_width, int arg_height, int arg_depth, int) : width(arg_width), height(arg_height), depth(arg_depth)
+	{
+		bricksX = (arg_width + BRICK_MASK) >> BRICK_SHIFT;
+		bricksY = (arg_height + BRICK_MASK) >> BRICK_SHIFT;
+		bricksZ = (arg_depth + BRICK_MASK) >> BRICK_SHIFT;
+	}
+	inline int GenerateIndex(int arg_x, int arg_y, int arg_z) const
+	{
+		int brick = (arg_x >> BRICK_SHIFT) + ((arg_y >> BRICK_SHIFT) + (arg_z >> BRICK_SHIFT) * bricksY) * bricksX;
+		return (brick << (3 * BRICK_SHIFT)) + (arg_x & BRICK_MASK)
+			+ ((arg_y & BRICK_MASK) << BRICK_SHIFT) + ((arg_z & BRICK_MASK) << (2 * BRICK_SHIFT));
+	}
+	int storageSize() const { return bricksX * bricksY * bricksZ * BRICK * BRICK * BRICK; }
+};
+
+#endif
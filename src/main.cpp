@@ -1,5 +1,10 @@
 #include "common.h"
+#include "sweep.h"
+#include "input_log.h"
+#include "selfcheck.h"
 #include <iostream>
+#include <fstream>
+#include <cstring>
 
 // Create a NULL-terminated string by reading the provided file
 static char* readShaderSource(const char* shaderFile)
@@ -98,6 +103,63 @@ void timer(int unused)
 
 int main(int argc, char** argv)
 {
+	// --sweep "<specification>" [results.csv] runs a parameter sweep instead of the viewer
+	if (argc >= 3 && strcmp(argv[1], "--sweep") == 0)
+	{
+		SweepSpec spec;
+		std::string error;
+		if (!spec.parse(argv[2], &error))
+		{
+			std::cerr << "Invalid sweep specification: " << error << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::vector<SweepResult> results = RunSweep(spec);
+		if (argc >= 4)
+		{
+			std::ofstream out(argv[3]);
+			WriteSweepCsv(results, out);
+		}
+		else
+		{
+			WriteSweepCsv(results, std::cout);
+		}
+		return 0;
+	}
+
+	// --replay <input log> steps a recorded session without a window
+	if (argc >= 3 && strcmp(argv[1], "--replay") == 0)
+	{
+		InputReplay* replay = InputReplay::Open(argv[2]);
+		if (!replay)
+		{
+			std::cerr << "Cannot read input log: " << argv[2] << std::endl;
+			return EXIT_FAILURE;
+		}
+		ReplayResult result = ReplayHeadless(*replay, FRAME_RATE_MS);
+		char hash[17];
+		snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)result.densityHash);
+		std::cout << "replayed " << result.frames << " frames, " << result.msPerFrame << " ms per frame, density " << hash << std::endl;
+		delete replay;
+		return 0;
+	}
+	// --self-check runs the simulators' consistency checks, failing if any does not hold
+	if (argc >= 2 && strcmp(argv[1], "--self-check") == 0)
+	{
+		return RunSelfChecks(std::cout) == 0 ? 0 : EXIT_FAILURE;
+	}
+
+	// --record-input <file> logs the viewer's input, --replay-input <file> plays a log back in the viewer
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--record-input") == 0)
+		{
+			recordInput(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--replay-input") == 0)
+		{
+			replayInput(argv[++i]);
+		}
+	}
+
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
 	glutInitWindowSize(512, 512);
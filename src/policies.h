@@ -0,0 +1,253 @@
+#pragma once
+#ifndef POLICIES_H
+#define POLICIES_H
+#include "activity.h"
+#include <cmath>
+#include <vector>
+
+// Strategy policies for FluidSimulator. Each policy is a stateless class of
+// static member templates that receive the simulator they run on, so the
+// choice of solver, advection scheme and boundary is made at compile time
+// and the calls inline into the simulator's hot loops.
+//
+// Interior loops walk the row spans of the simulator's ActivityMap rather
+// than the full row, so quiescent tiles are skipped when tracking is on.
+//
+// Boundary kinds, passed as the template argument B:
+//   0 scalar field, 1 horizontal velocity, 2 vertical velocity
+
+// In-place Gauss-Seidel sweeps in row order
+class GaussSeidelSolver
+{
+public:
+	template <int B, typename Sim>
+	static void linearSolve(Sim& arg_sim, typename Sim::Storage* x, const typename Sim::Storage* x0, typename Sim::Compute ax, typename Sim::Compute ay, typename Sim::Compute c)
+	{
+		typedef typename Sim::Storage Storage;
+		typedef typename Sim::Compute Compute;
+		const int h = arg_sim.GRID_HEIGHT;
+		Compute cInverse = Compute(1) / c;
+		for (int k = 0; k < arg_sim.NUM_ITERATIONS; k++) {
+			for (int j = 1; j < h - 1; j++) {
+				const std::vector<CellSpan>& spans = arg_sim.ACTIVITY.rowSpans(j);
+				for (size_t s = 0; s < spans.size(); s++) {
+					for (int i = spans[s].begin; i < spans[s].end; i++) {
+						x[arg_sim.GenerateIndex(i, j)] = Storage((Compute(x0[arg_sim.GenerateIndex(i, j)])
+							+ ax * (Compute(x[arg_sim.GenerateIndex(i + 1, j)]) + Compute(x[arg_sim.GenerateIndex(i - 1, j)]))
+							+ ay * (Compute(x[arg_sim.GenerateIndex(i, j + 1)]) + Compute(x[arg_sim.GenerateIndex(i, j - 1)]))
+							) * cInverse);
+					}
+				}
+			}
+			arg_sim.template setBoundaries<B>(x);
+		}
+	}
+};
+
+// Gauss-Seidel in checkerboard order: every cell of one colour only reads
+// cells of the other colour, so each half sweep has no ordering dependency
+class RedBlackSolver
+{
+public:
+	template <int B, typename Sim>
+	static void linearSolve(Sim& arg_sim, typename Sim::Storage* x, const typename Sim::Storage* x0, typename Sim::Compute ax, typename Sim::Compute ay, typename Sim::Compute c)
+	{
+		typedef typename Sim::Storage Storage;
+		typedef typename Sim::Compute Compute;
+		const int h = arg_sim.GRID_HEIGHT;
+		Compute cInverse = Compute(1) / c;
+		for (int k = 0; k < arg_sim.NUM_ITERATIONS; k++) {
+			for (int colour = 0; colour < 2; colour++) {
+				for (int j = 1; j < h - 1; j++) {
+					const std::vector<CellSpan>& spans = arg_sim.ACTIVITY.rowSpans(j);
+					for (size_t s = 0; s < spans.size(); s++) {
+						// start on the first cell of this colour, where i + j + colour is even
+						int begin = spans[s].begin;
+						for (int i = begin + ((begin + j + colour) & 1); i < spans[s].end; i += 2) {
+							x[arg_sim.GenerateIndex(i, j)] = Storage((Compute(x0[arg_sim.GenerateIndex(i, j)])
+								+ ax * (Compute(x[arg_sim.GenerateIndex(i + 1, j)]) + Compute(x[arg_sim.GenerateIndex(i - 1, j)]))
+								+ ay * (Compute(x[arg_sim.GenerateIndex(i, j + 1)]) + Compute(x[arg_sim.GenerateIndex(i, j - 1)]))
+								) * cInverse);
+						}
+					}
+				}
+			}
+			arg_sim.template setBoundaries<B>(x);
+		}
+	}
+};
+
+// Semi-Lagrangian backtrace with bilinear interpolation
+class BilinearAdvector
+{
+public:
+	template <int B, typename Sim>
+	static void advect(Sim& arg_sim, typename Sim::Storage* d, const typename Sim::Storage* d0, const typename Sim::Storage* veloX, const typename Sim::Storage* veloY, typename Sim::Compute dt)
+	{
+		typedef typename Sim::Storage Storage;
+		typedef typename Sim::Compute Compute;
+		const int w = arg_sim.GRID_WIDTH;
+		const int h = arg_sim.GRID_HEIGHT;
+		Compute dtx = dt / arg_sim.FLUID_CELL->cellSizeX;
+		Compute dty = dt / arg_sim.FLUID_CELL->cellSizeY;
+		Compute maxX = Compute(w) - Compute(1.5f);
+		Compute maxY = Compute(h) - Compute(1.5f);
+
+		for (int j = 1; j < h - 1; j++) {
+			const std::vector<CellSpan>& spans = arg_sim.ACTIVITY.rowSpans(j);
+			for (size_t s = 0; s < spans.size(); s++) {
+				for (int i = spans[s].begin; i < spans[s].end; i++) {
+					int index = arg_sim.GenerateIndex(i, j);
+					Compute x = Compute(i) - dtx * Compute(veloX[index]);
+					Compute y = Compute(j) - dty * Compute(veloY[index]);
+					if (x < Compute(0.5f)) x = Compute(0.5f);
+					if (x > maxX) x = maxX;
+					if (y < Compute(0.5f)) y = Compute(0.5f);
+					if (y > maxY) y = maxY;
+					Compute i0 = std::floor(x);
+					Compute j0 = std::floor(y);
+					Compute s1 = x - i0;
+					Compute s0 = Compute(1) - s1;
+					Compute t1 = y - j0;
+					Compute t0 = Compute(1) - t1;
+
+					int i0i = (int)i0;
+					int j0i = (int)j0;
+
+					d[index] = Storage(
+						s0 * (t0 * Compute(d0[arg_sim.GenerateIndex(i0i, j0i)]) + t1 * Compute(d0[arg_sim.GenerateIndex(i0i, j0i + 1)])) +
+						s1 * (t0 * Compute(d0[arg_sim.GenerateIndex(i0i + 1, j0i)]) + t1 * Compute(d0[arg_sim.GenerateIndex(i0i + 1, j0i + 1)])));
+				}
+			}
+		}
+		arg_sim.template setBoundaries<B>(d);
+	}
+};
+
+// Semi-Lagrangian backtrace that takes the nearest cell, one load per cell
+// instead of four at the cost of extra numerical diffusion
+class NearestAdvector
+{
+public:
+	template <int B, typename Sim>
+	static void advect(Sim& arg_sim, typename Sim::Storage* d, const typename Sim::Storage* d0, const typename Sim::Storage* veloX, const typename Sim::Storage* veloY, typename Sim::Compute dt)
+	{
+		typedef typename Sim::Compute Compute;
+		const int w = arg_sim.GRID_WIDTH;
+		const int h = arg_sim.GRID_HEIGHT;
+		Compute dtx = dt / arg_sim.FLUID_CELL->cellSizeX;
+		Compute dty = dt / arg_sim.FLUID_CELL->cellSizeY;
+		Compute maxX = Compute(w) - Compute(1.5f);
+		Compute maxY = Compute(h) - Compute(1.5f);
+
+		for (int j = 1; j < h - 1; j++) {
+			const std::vector<CellSpan>& spans = arg_sim.ACTIVITY.rowSpans(j);
+			for (size_t s = 0; s < spans.size(); s++) {
+				for (int i = spans[s].begin; i < spans[s].end; i++) {
+					int index = arg_sim.GenerateIndex(i, j);
+					Compute x = Compute(i) - dtx * Compute(veloX[index]);
+					Compute y = Compute(j) - dty * Compute(veloY[index]);
+					if (x < Compute(0.5f)) x = Compute(0.5f);
+					if (x > maxX) x = maxX;
+					if (y < Compute(0.5f)) y = Compute(0.5f);
+					if (y > maxY) y = maxY;
+					d[index] = d0[arg_sim.GenerateIndex((int)(x + Compute(0.5f)), (int)(y + Compute(0.5f)))];
+				}
+			}
+		}
+		arg_sim.template setBoundaries<B>(d);
+	}
+};
+
+// Centre weights of the implicit diffusion and pressure stencils, given the
+// weights ax and ay of the neighbours along each axis.
+// The simulator's original weights, 1 + 3(ax + ay) and 3(ax + ay), which are
+// 1 + 6a and 6 on square cells. They exceed the four neighbour weights, so
+// every solve also damps its field, harder as a grows.
+class ClassicStencil
+{
+public:
+	template <typename Compute>
+	static Compute diffusionCentre(Compute ax, Compute ay) { return Compute(1) + Compute(3) * (ax + ay); }
+	template <typename Compute>
+	static Compute pressureCentre(Compute ax, Compute ay) { return Compute(3) * (ax + ay); }
+};
+
+// Centre weights equal to the neighbour weights they balance, 1 + 2(ax + ay)
+// and 2(ax + ay), so a solve redistributes its field without losing any.
+// Used by both levels of AdaptiveSimulator, whose patches' a grows with
+// refinement^2.
+class ConservativeStencil
+{
+public:
+	template <typename Compute>
+	static Compute diffusionCentre(Compute ax, Compute ay) { return Compute(1) + Compute(2) * (ax + ay); }
+	template <typename Compute>
+	static Compute pressureCentre(Compute ax, Compute ay) { return Compute(2) * (ax + ay); }
+};
+
+// Closed box: walls mirror scalars and reflect the normal velocity component
+class BoxBoundary
+{
+public:
+	template <int B, typename Sim>
+	static void apply(Sim& arg_sim, typename Sim::Storage* x)
+	{
+		typedef typename Sim::Storage Storage;
+		typedef typename Sim::Compute Compute;
+		const int w = arg_sim.GRID_WIDTH;
+		const int h = arg_sim.GRID_HEIGHT;
+		for (int i = 1; i < w - 1; i++) {
+			x[arg_sim.GenerateIndex(i, 0)] = B == 2 ? Storage(-Compute(x[arg_sim.GenerateIndex(i, 1)])) : x[arg_sim.GenerateIndex(i, 1)];
+			x[arg_sim.GenerateIndex(i, h - 1)] = B == 2 ? Storage(-Compute(x[arg_sim.GenerateIndex(i, h - 2)])) : x[arg_sim.GenerateIndex(i, h - 2)];
+		}
+
+		for (int j = 1; j < h - 1; j++) {
+			x[arg_sim.GenerateIndex(0, j)] = B == 1 ? Storage(-Compute(x[arg_sim.GenerateIndex(1, j)])) : x[arg_sim.GenerateIndex(1, j)];
+			x[arg_sim.GenerateIndex(w - 1, j)] = B == 1 ? Storage(-Compute(x[arg_sim.GenerateIndex(w - 2, j)])) : x[arg_sim.GenerateIndex(w - 2, j)];
+		}
+
+		x[arg_sim.GenerateIndex(0, 0)] = Storage((Compute(x[arg_sim.GenerateIndex(1, 0)]) + Compute(x[arg_sim.GenerateIndex(0, 1)])) * Compute(0.5f));
+		x[arg_sim.GenerateIndex(0, h - 1)] = Storage((Compute(x[arg_sim.GenerateIndex(1, h - 1)]) + Compute(x[arg_sim.GenerateIndex(0, h - 2)])) * Compute(0.5f));
+		x[arg_sim.GenerateIndex(w - 1, 0)] = Storage((Compute(x[arg_sim.GenerateIndex(w - 2, 0)]) + Compute(x[arg_sim.GenerateIndex(w - 1, 1)])) * Compute(0.5f));
+		x[arg_sim.GenerateIndex(w - 1, h - 1)] = Storage((Compute(x[arg_sim.GenerateIndex(w - 2, h - 1)]) + Compute(x[arg_sim.GenerateIndex(w - 1, h - 2)])) * Compute(0.5f));
+	}
+};
+
+// Wrap-around domain: each ghost row/column copies the interior row/column
+// on the opposite side. Advection still clamps backtraces to the grid.
+class PeriodicBoundary
+{
+public:
+	template <int B, typename Sim>
+	static void apply(Sim& arg_sim, typename Sim::Storage* x)
+	{
+		const int w = arg_sim.GRID_WIDTH;
+		const int h = arg_sim.GRID_HEIGHT;
+		for (int i = 1; i < w - 1; i++) {
+			x[arg_sim.GenerateIndex(i, 0)] = x[arg_sim.GenerateIndex(i, h - 2)];
+			x[arg_sim.GenerateIndex(i, h - 1)] = x[arg_sim.GenerateIndex(i, 1)];
+		}
+
+		for (int j = 1; j < h - 1; j++) {
+			x[arg_sim.GenerateIndex(0, j)] = x[arg_sim.GenerateIndex(w - 2, j)];
+			x[arg_sim.GenerateIndex(w - 1, j)] = x[arg_sim.GenerateIndex(1, j)];
+		}
+
+		x[arg_sim.GenerateIndex(0, 0)] = x[arg_sim.GenerateIndex(w - 2, h - 2)];
+		x[arg_sim.GenerateIndex(0, h - 1)] = x[arg_sim.GenerateIndex(w - 2, 1)];
+		x[arg_sim.GenerateIndex(w - 1, 0)] = x[arg_sim.GenerateIndex(1, h - 2)];
+		x[arg_sim.GenerateIndex(w - 1, h - 1)] = x[arg_sim.GenerateIndex(1, 1)];
+	}
+};
+
+// Keeps every ghost value as the driver set it. Used by AdaptiveSimulator
+// patches, whose outer ring is filled from the coarse level before each step.
+class FixedBoundary
+{
+public:
+	template <int B, typename Sim>
+	static void apply(Sim&, typename Sim::Storage*) {}
+};
+
+#endif
@@ -0,0 +1,127 @@
+#pragma once
+#ifndef PRECISION_H
+#define PRECISION_H
+#include <cstdint>
+#include <cstring>
+// AVX2 does not imply F16C, so only the F16C macro selects the instructions
+#if defined(__F16C__)
+#  include <immintrin.h>
+#  define PRECISION_HAS_F16C
+#endif
+
+// IEEE 754 binary16 storage. Values are converted to float on load and
+// rounded to nearest even on store; arithmetic always happens in float.
+class Half
+{
+public:
+	uint16_t bits;
+	Half() {}
+	Half(float arg_value) : bits(FromFloat(arg_value)) {}
+	operator float() const { return ToFloat(bits); }
+
+	static inline uint16_t FromFloat(float arg_value)
+	{
+#ifdef PRECISION_HAS_F16C
+		return (uint16_t)_cvtss_sh(arg_value, 0);
+#else
+		uint32_t u;
+		memcpy(&u, &arg_value, sizeof(u));
+		uint16_t sign = (uint16_t)((u >> 16) & 0x8000u);
+		u &= 0x7fffffffu;
+		if (u >= 0x47800000u)
+		{
+			// 65536 and up, infinity and NaN; NaNs stay quiet
+			return sign | (u > 0x7f800000u ? 0x7e00u : 0x7c00u);
+		}
+		if (u < 0x38800000u)
+		{
+			// below the smallest normal half: adding 0.5 aligns the 10
+			// mantissa bits at the bottom, and the float add rounds them
+			float aligned;
+			memcpy(&aligned, &u, sizeof(aligned));
+			aligned += 0.5f;
+			memcpy(&u, &aligned, sizeof(u));
+			return sign | (uint16_t)(u - 0x3f000000u);
+		}
+		// rebias the exponent and round to nearest even; a carry out of the
+		// mantissa bumps the exponent, up to infinity from 65520
+		u += 0xc8000fffu + ((u >> 13) & 1u);
+		return sign | (uint16_t)(u >> 13);
+#endif
+	}
+	static inline float ToFloat(uint16_t arg_bits)
+	{
+#ifdef PRECISION_HAS_F16C
+		return _cvtsh_ss(arg_bits);
+#else
+		uint32_t u = (uint32_t)(arg_bits & 0x7fffu) << 13;
+		uint32_t exponent = u & 0x0f800000u;
+		u += 0x38000000u;
+		if (exponent == 0x0f800000u)
+		{
+			// infinity and NaN keep an all-ones exponent
+			u += 0x38000000u;
+		}
+		else if (exponent == 0)
+		{
+			// subnormal: take the mantissa as a float and remove the implied one
+			u += 0x00800000u;
+			float value;
+			memcpy(&value, &u, sizeof(value));
+			value -= 6.103515625e-05f;
+			memcpy(&u, &value, sizeof(u));
+		}
+		u |= (uint32_t)(arg_bits & 0x8000u) << 16;
+		float value;
+		memcpy(&value, &u, sizeof(value));
+		return value;
+#endif
+	}
+};
+
+// bfloat16 storage: the upper half of a float, keeping the full float
+// exponent range with an 8 bit mantissa. Stores round to nearest even.
+class BFloat16
+{
+public:
+	uint16_t bits;
+	BFloat16() {}
+	BFloat16(float arg_value) : bits(FromFloat(arg_value)) {}
+	operator float() const { return ToFloat(bits); }
+
+	static inline uint16_t FromFloat(float arg_value)
+	{
+		uint32_t u;
+		memcpy(&u, &arg_value, sizeof(u));
+		if ((u & 0x7fffffffu) > 0x7f800000u)
+		{
+			// keep NaNs quiet instead of rounding them into infinity
+			return (uint16_t)((u >> 16) | 0x0040u);
+		}
+		u += 0x7fffu + ((u >> 16) & 1u);
+		return (uint16_t)(u >> 16);
+	}
+	static inline float ToFloat(uint16_t arg_bits)
+	{
+		uint32_t u = (uint32_t)arg_bits << 16;
+		float value;
+		memcpy(&value, &u, sizeof(value));
+		return value;
+	}
+};
+
+// Pairs the type fields are stored in with the type kernels compute in
+template <typename Storage, typename Compute>
+class Precision
+{
+public:
+	typedef Storage storage_type;
+	typedef Compute compute_type;
+};
+
+typedef Precision<float, float> FloatPrecision;
+typedef Precision<double, double> DoublePrecision;
+typedef Precision<Half, float> HalfPrecision;
+typedef Precision<BFloat16, float> BFloat16Precision;
+
+#endif
@@ -0,0 +1,203 @@
+#include "quality.h"
+#include <glm/glm.hpp>
+#include <chrono>
+#include <cstdio>
+
+// bilinear resampling between cell-centred grids covering the same domain
+static void Resample(const float* arg_src, int arg_srcWidth, int arg_srcHeight, float* arg_dst, int arg_dstWidth, int arg_dstHeight)
+{
+	float scaleX = (float)arg_srcWidth / arg_dstWidth;
+	float scaleY = (float)arg_srcHeight / arg_dstHeight;
+	for (int j = 0; j < arg_dstHeight; j++) {
+		float y = glm::clamp((j + 0.5f) * scaleY - 0.5f, 0.0f, (float)(arg_srcHeight - 1));
+		int y0 = (int)y;
+		int y1 = glm::min(y0 + 1, arg_srcHeight - 1);
+		float ty = y - y0;
+		for (int i = 0; i < arg_dstWidth; i++) {
+			float x = glm::clamp((i + 0.5f) * scaleX - 0.5f, 0.0f, (float)(arg_srcWidth - 1));
+			int x0 = (int)x;
+			int x1 = glm::min(x0 + 1, arg_srcWidth - 1);
+			float tx = x - x0;
+			float bottom = glm::mix(arg_src[x0 + y0 * arg_srcWidth], arg_src[x1 + y0 * arg_srcWidth], tx);
+			float top = glm::mix(arg_src[x0 + y1 * arg_srcWidth], arg_src[x1 + y1 * arg_srcWidth], tx);
+			arg_dst[i + j * arg_dstWidth] = glm::mix(bottom, top, ty);
+		}
+	}
+}
+
+QualityController::QualityController(const SimulatorConfig& arg_config, double arg_budgetMs)
+	: budgetMs(arg_budgetMs), highWater(0.9), lowWater(0.45), smoothing(0.1), downgradeFrames(5), upgradeFrames(120), adaptive(true),
+	baseConfig(arg_config), level(0), averageMs(-1.0), framesOver(0), framesUnder(0), settleFrames(0)
+{
+	buildLevels();
+	upgradeDelay.assign(levels.size(), upgradeFrames);
+	simulator = createLevel(levels[0]);
+}
+
+QualityController::~QualityController()
+{
+	delete simulator;
+}
+
+// Each rung costs about half of the one above: red-black is roughly twice as
+// fast as Gauss-Seidel, halving iterations halves the solve, and halving the
+// grid quarters everything. Red-black is only instantiated for float storage.
+void QualityController::buildLevels()
+{
+	SolverKind fast = baseConfig.precision == PRECISION_FLOAT ? SOLVER_RED_BLACK : baseConfig.solver;
+	int iterations = baseConfig.iterations;
+	int fewer = glm::max(4, iterations / 2);
+	levels.push_back(QualityLevel(baseConfig.solver, iterations, 1));
+	for (int divisor = 1; glm::min(baseConfig.width, baseConfig.height) / divisor >= 32; divisor *= 2) {
+		if (divisor > 1 || fast != baseConfig.solver)
+		{
+			levels.push_back(QualityLevel(fast, iterations, divisor));
+		}
+		if (fewer < iterations)
+		{
+			levels.push_back(QualityLevel(fast, fewer, divisor));
+		}
+	}
+}
+
+RuntimeSimulator* QualityController::createLevel(const QualityLevel& arg_level) const
+{
+	SimulatorConfig config = baseConfig;
+	config.solver = arg_level.solver;
+	config.iterations = arg_level.iterations;
+	if (arg_level.divisor > 1)
+	{
+		// keep the physical domain, so velocities and viscosity mean the same on every grid
+		float defaultSize = 1.0f / (glm::max(baseConfig.width, baseConfig.height) - 2);
+		float baseSizeX = baseConfig.cellSizeX > 0.0f ? baseConfig.cellSizeX : defaultSize;
+		float baseSizeY = baseConfig.cellSizeY > 0.0f ? baseConfig.cellSizeY : defaultSize;
+		config.width = baseConfig.width / arg_level.divisor;
+		config.height = baseConfig.height / arg_level.divisor;
+		config.cellSizeX = baseSizeX * (baseConfig.width - 2) / (config.width - 2);
+		config.cellSizeY = baseSizeY * (baseConfig.height - 2) / (config.height - 2);
+	}
+	return RuntimeSimulator::Create(config);
+}
+
+void QualityController::setLevel(int arg_level)
+{
+	arg_level = glm::clamp(arg_level, 0, (int)levels.size() - 1);
+	if (arg_level == level)
+	{
+		return;
+	}
+	const QualityLevel& current = levels[level];
+	const QualityLevel& next = levels[arg_level];
+	if (next.solver == current.solver && next.divisor == current.divisor)
+	{
+		simulator->setIterations(next.iterations);
+	}
+	else
+	{
+		RuntimeSimulator* replacement = createLevel(next);
+		if (!replacement)
+		{
+			return;
+		}
+		int width = simulator->getWidth();
+		int height = simulator->getHeight();
+		int newWidth = replacement->getWidth();
+		int newHeight = replacement->getHeight();
+		std::vector<float> density(width * height), veloX(width * height), veloY(width * height);
+		simulator->readDensity(density.data());
+		simulator->readVelocity(veloX.data(), veloY.data());
+		scratchDensity.resize(newWidth * newHeight);
+		scratchVeloX.resize(newWidth * newHeight);
+		scratchVeloY.resize(newWidth * newHeight);
+		Resample(density.data(), width, height, scratchDensity.data(), newWidth, newHeight);
+		Resample(veloX.data(), width, height, scratchVeloX.data(), newWidth, newHeight);
+		Resample(veloY.data(), width, height, scratchVeloY.data(), newWidth, newHeight);
+		replacement->writeState(scratchDensity.data(), scratchVeloX.data(), scratchVeloY.data());
+		delete simulator;
+		simulator = replacement;
+	}
+	level = arg_level;
+	averageMs = -1.0;
+	framesOver = 0;
+	framesUnder = 0;
+	settleFrames = 3;
+}
+
+int QualityController::advance(float arg_frameTime)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int substeps = simulator->advance(arg_frameTime);
+	recordStep(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	return substeps;
+}
+
+void QualityController::recordStep(double arg_ms)
+{
+	if (settleFrames > 0)
+	{
+		settleFrames--;
+		return;
+	}
+	averageMs = averageMs < 0.0 ? arg_ms : averageMs + smoothing * (arg_ms - averageMs);
+	framesOver = averageMs > budgetMs * highWater ? framesOver + 1 : 0;
+	framesUnder = averageMs < budgetMs * lowWater ? framesUnder + 1 : 0;
+	if (!adaptive)
+	{
+		return;
+	}
+
+	if (framesOver >= downgradeFrames && level + 1 < (int)levels.size())
+	{
+		upgradeDelay[level] = glm::min(upgradeDelay[level] * 2, upgradeFrames * 16);
+		setLevel(level + 1);
+	}
+	else if (level > 0 && framesUnder >= upgradeDelay[level - 1])
+	{
+		setLevel(level - 1);
+	}
+}
+
+void QualityController::addDye(int arg_posX, int arg_posY, float arg_amount)
+{
+	int divisor = levels[level].divisor;
+	simulator->addDye(glm::min(arg_posX / divisor, simulator->getWidth() - 1), glm::min(arg_posY / divisor, simulator->getHeight() - 1), arg_amount);
+}
+
+void QualityController::addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY)
+{
+	int divisor = levels[level].divisor;
+	simulator->addVelocity(glm::min(arg_posX / divisor, simulator->getWidth() - 1), glm::min(arg_posY / divisor, simulator->getHeight() - 1), arg_amountX, arg_amountY);
+}
+
+void QualityController::fadeDensity(float arg_amount)
+{
+	simulator->fadeDensity(arg_amount);
+}
+
+void QualityController::readDensity(float* arg_out)
+{
+	if (levels[level].divisor == 1)
+	{
+		simulator->readDensity(arg_out);
+		return;
+	}
+	int width = simulator->getWidth();
+	int height = simulator->getHeight();
+	scratchDensity.resize(width * height);
+	simulator->readDensity(scratchDensity.data());
+	Resample(scratchDensity.data(), width, height, arg_out, baseConfig.width, baseConfig.height);
+}
+
+std::string QualityController::describe() const
+{
+	const QualityLevel& current = levels[level];
+	char text[128];
+	int length = snprintf(text, sizeof(text), "quality %d/%d: %s, %d iterations, %dx%d",
+		level, (int)levels.size() - 1, current.solver == SOLVER_RED_BLACK ? "red-black" : "gauss-seidel",
+		current.iterations, simulator->getWidth(), simulator->getHeight());
+	if (averageMs >= 0.0)
+	{
+		snprintf(text + length, sizeof(text) - length, ", %.1f of %.1f ms", averageMs, budgetMs);
+	}
+	return text;
+}
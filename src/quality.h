@@ -0,0 +1,78 @@
+#pragma once
+#ifndef QUALITY_H
+#define QUALITY_H
+#include "runtime_simulator.h"
+#include <string>
+#include <vector>
+
+// One rung of the quality ladder
+class QualityLevel
+{
+public:
+	SolverKind solver;
+	int iterations;
+	// the simulation grid is the display grid divided by this along each axis
+	int divisor;
+	QualityLevel(SolverKind arg_solver, int arg_iterations, int arg_divisor)
+		: solver(arg_solver), iterations(arg_iterations), divisor(arg_divisor) {}
+};
+
+// Holds the step time under a frame budget by trading accuracy for speed.
+// Levels run from the configured simulator (0) down through the red-black
+// solver, fewer iterations and coarser grids, each roughly halving the cost
+// of the one before. The smoothed step time must stay above highWater of the
+// budget for downgradeFrames before dropping a level, and below lowWater for
+// upgradeFrames before climbing back; every time a level proves too slow the
+// wait to retry it doubles. Positions and readDensity always use the display
+// grid of the base config, whatever grid the simulation is running on.
+class QualityController
+{
+public:
+	double budgetMs;
+	double highWater, lowWater;
+	// weight of the newest sample in the smoothed step time
+	double smoothing;
+	int downgradeFrames, upgradeFrames;
+	// false keeps the level where setLevel() puts it, e.g. while replaying recorded input
+	bool adaptive;
+
+	QualityController(const SimulatorConfig& arg_config, double arg_budgetMs);
+	QualityController(const QualityController&) = delete;
+	QualityController& operator=(const QualityController&) = delete;
+	~QualityController();
+	// timed RuntimeSimulator::advance, may switch level afterwards
+	int advance(float arg_frameTime);
+	void addDye(int arg_posX, int arg_posY, float arg_amount);
+	void addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY);
+	void fadeDensity(float arg_amount);
+	// writes the density on the display grid, row by row
+	void readDensity(float* arg_out);
+	int getLevel() const { return level; }
+	int getLevelCount() const { return (int)levels.size(); }
+	const QualityLevel& getQualityLevel() const { return levels[level]; }
+	double getAverageStepMs() const { return averageMs; }
+	// e.g. "quality 2/5: red-black, 8 iterations, 64x64, 9.1 of 16.7 ms"
+	std::string describe() const;
+	// forces a level, carrying the current fluid state across
+	void setLevel(int arg_level);
+	RuntimeSimulator* getSimulator() const { return simulator; }
+
+private:
+	SimulatorConfig baseConfig;
+	std::vector<QualityLevel> levels;
+	// frames a level must look affordable for before moving up into it
+	std::vector<int> upgradeDelay;
+	int level;
+	RuntimeSimulator* simulator;
+	double averageMs;
+	int framesOver, framesUnder;
+	// samples ignored after a switch, the first steps on a new grid touch fresh memory
+	int settleFrames;
+	std::vector<float> scratchDensity, scratchVeloX, scratchVeloY;
+
+	void buildLevels();
+	RuntimeSimulator* createLevel(const QualityLevel& arg_level) const;
+	void recordStep(double arg_ms);
+};
+
+#endif
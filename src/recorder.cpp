@@ -0,0 +1,318 @@
+#include "recorder.h"
+#include <algorithm>
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+static const char RECORDING_MAGIC[8] = { 'F', 'L', 'U', 'I', 'D', 'R', 'C', 0 };
+static const uint32_t RECORDING_VERSION = 1;
+
+#ifdef _WIN32
+
+// Windows has no positioned gather write for buffered files, so each frame
+// of the batch goes out at its own offset
+static bool WriteAt(intptr_t arg_file, const char* arg_data, size_t arg_bytes, uint64_t arg_offset)
+{
+	while (arg_bytes > 0)
+	{
+		OVERLAPPED position = {};
+		position.Offset = (DWORD)arg_offset;
+		position.OffsetHigh = (DWORD)(arg_offset >> 32);
+		DWORD chunk = (DWORD)(arg_bytes < (1u << 30) ? arg_bytes : (1u << 30));
+		DWORD written = 0;
+		if (!WriteFile((HANDLE)arg_file, arg_data, chunk, &written, &position) || written == 0)
+		{
+			return false;
+		}
+		arg_data += written;
+		arg_bytes -= written;
+		arg_offset += written;
+	}
+	return true;
+}
+
+#else
+
+static bool WriteAt(intptr_t arg_file, const char* arg_data, size_t arg_bytes, uint64_t arg_offset)
+{
+	while (arg_bytes > 0)
+	{
+		ssize_t count = pwrite((int)arg_file, arg_data, arg_bytes, (off_t)arg_offset);
+		if (count < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (count <= 0)
+		{
+			return false;
+		}
+		arg_data += count;
+		arg_bytes -= count;
+		arg_offset += count;
+	}
+	return true;
+}
+
+#endif
+
+FrameRecorder* FrameRecorder::Create(const char* arg_path, const RecorderConfig& arg_config)
+{
+	if (arg_config.width < 1 || arg_config.height < 1 || arg_config.poolFrames < 1 || arg_config.batchFrames < 1)
+	{
+		return nullptr;
+	}
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(arg_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		return nullptr;
+	}
+	intptr_t file = (intptr_t)handle;
+#else
+	int descriptor = open(arg_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (descriptor < 0)
+	{
+		return nullptr;
+	}
+	intptr_t file = descriptor;
+#endif
+	FrameRecorder* recorder = new FrameRecorder(arg_config, file);
+
+	RecordingHeader header = {};
+	memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+	header.version = RECORDING_VERSION;
+	header.width = arg_config.width;
+	header.height = arg_config.height;
+	header.channels = arg_config.withVelocity ? 3 : 1;
+	header.frameBytes = recorder->frameBytes;
+	if (!WriteAt(file, (const char*)&header, sizeof(header), 0))
+	{
+		delete recorder;
+		return nullptr;
+	}
+	return recorder;
+}
+
+FrameRecorder::FrameRecorder(const RecorderConfig& arg_config, intptr_t arg_file)
+	: config(arg_config), nextIndex(0), written(0), dropped(0), failed(false), stopping(false), file(arg_file)
+{
+	size_t channels = config.withVelocity ? 3 : 1;
+	frameBytes = sizeof(FrameHeader) + channels * config.width * config.height * sizeof(float);
+	// every buffer is touched here, so no page faults land on the solver thread later
+	pool.assign(config.poolFrames * frameBytes, 0);
+	for (int i = 0; i < config.poolFrames; i++) {
+		freeSlots.push_back(i);
+	}
+	writer = std::thread(&FrameRecorder::runWriter, this);
+}
+
+FrameRecorder::~FrameRecorder()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	frameQueued.notify_one();
+	writer.join();
+#ifdef _WIN32
+	CloseHandle((HANDLE)file);
+#else
+	close((int)file);
+#endif
+}
+
+int FrameRecorder::acquireSlot()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (freeSlots.empty())
+	{
+		if (config.policy == BACKPRESSURE_DROP)
+		{
+			dropped++;
+			return -1;
+		}
+		slotFreed.wait(lock, [this] { return !freeSlots.empty(); });
+	}
+	int slot = freeSlots.front();
+	freeSlots.pop_front();
+	return slot;
+}
+
+void FrameRecorder::queueSlot(int arg_slot)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		QueuedFrame frame;
+		frame.slot = arg_slot;
+		frame.index = nextIndex++;
+		queued.push_back(frame);
+	}
+	frameQueued.notify_one();
+}
+
+// The copy into the pooled buffer happens outside the lock, so the writer
+// can keep draining while the solver thread fills the next frame
+bool FrameRecorder::record(const RuntimeSimulator& arg_simulator, uint64_t arg_step)
+{
+	// the pooled buffers are sized for config, a larger grid would overrun them
+	if (arg_simulator.getWidth() != config.width || arg_simulator.getHeight() != config.height)
+	{
+		return false;
+	}
+	int slot = acquireSlot();
+	if (slot < 0)
+	{
+		return false;
+	}
+	char* data = slotData(slot);
+	FrameHeader header = {};
+	header.step = arg_step;
+	memcpy(data, &header, sizeof(header));
+	float* density = (float*)(data + sizeof(FrameHeader));
+	arg_simulator.readDensity(density);
+	if (config.withVelocity)
+	{
+		size_t cells = (size_t)config.width * config.height;
+		arg_simulator.readVelocity(density + cells, density + 2 * cells);
+	}
+	queueSlot(slot);
+	return true;
+}
+
+bool FrameRecorder::record(uint64_t arg_step, const float* arg_density, const float* arg_veloX, const float* arg_veloY)
+{
+	int slot = acquireSlot();
+	if (slot < 0)
+	{
+		return false;
+	}
+	char* data = slotData(slot);
+	FrameHeader header = {};
+	header.step = arg_step;
+	memcpy(data, &header, sizeof(header));
+	size_t planeBytes = (size_t)config.width * config.height * sizeof(float);
+	data += sizeof(FrameHeader);
+	memcpy(data, arg_density, planeBytes);
+	if (config.withVelocity)
+	{
+		memcpy(data + planeBytes, arg_veloX, planeBytes);
+		memcpy(data + 2 * planeBytes, arg_veloY, planeBytes);
+	}
+	queueSlot(slot);
+	return true;
+}
+
+void FrameRecorder::runWriter()
+{
+	std::vector<QueuedFrame> batch;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		frameQueued.wait(lock, [this] { return !queued.empty() || stopping; });
+		if (queued.empty())
+		{
+			return;
+		}
+		// frames are numbered in queue order, so any run from the front is contiguous on disk
+		batch.clear();
+		while (!queued.empty() && (int)batch.size() < config.batchFrames)
+		{
+			batch.push_back(queued.front());
+			queued.pop_front();
+		}
+		bool skip = failed;
+		lock.unlock();
+		bool ok = skip || writeBatch(batch);
+		lock.lock();
+		if (!skip)
+		{
+			if (ok)
+			{
+				written += batch.size();
+			}
+			else
+			{
+				failed = true;
+			}
+		}
+		for (size_t i = 0; i < batch.size(); i++) {
+			freeSlots.push_back(batch[i].slot);
+		}
+		slotFreed.notify_all();
+	}
+}
+
+bool FrameRecorder::writeBatch(const std::vector<QueuedFrame>& arg_batch)
+{
+	uint64_t offset = sizeof(RecordingHeader) + arg_batch[0].index * frameBytes;
+#ifdef _WIN32
+	for (size_t i = 0; i < arg_batch.size(); i++) {
+		if (!WriteAt(file, slotData(arg_batch[i].slot), frameBytes, offset + i * frameBytes))
+		{
+			return false;
+		}
+	}
+	return true;
+#else
+	// pooled slots are scattered in memory but adjacent in the file, so one
+	// gather write covers the batch; short writes resume where they stopped
+	std::vector<iovec> pieces(arg_batch.size());
+	for (size_t i = 0; i < arg_batch.size(); i++) {
+		pieces[i].iov_base = slotData(arg_batch[i].slot);
+		pieces[i].iov_len = frameBytes;
+	}
+	size_t first = 0;
+	while (first < pieces.size())
+	{
+		int count = (int)std::min(pieces.size() - first, (size_t)IOV_MAX);
+		ssize_t done = pwritev((int)file, pieces.data() + first, count, (off_t)offset);
+		if (done < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (done <= 0)
+		{
+			return false;
+		}
+		offset += done;
+		while (first < pieces.size() && (size_t)done >= pieces[first].iov_len)
+		{
+			done -= pieces[first].iov_len;
+			first++;
+		}
+		if (first < pieces.size())
+		{
+			pieces[first].iov_base = (char*)pieces[first].iov_base + done;
+			pieces[first].iov_len -= done;
+		}
+	}
+	return true;
+#endif
+}
+
+uint64_t FrameRecorder::getWrittenFrames() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return written;
+}
+
+uint64_t FrameRecorder::getDroppedFrames() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return dropped;
+}
+
+bool FrameRecorder::hasFailed() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return failed;
+}
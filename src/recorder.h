@@ -0,0 +1,107 @@
+#pragma once
+#ifndef RECORDER_H
+#define RECORDER_H
+#include "runtime_simulator.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// What record() does when every pooled buffer is still queued for writing
+enum BackpressurePolicy { BACKPRESSURE_BLOCK, BACKPRESSURE_DROP };
+
+class RecorderConfig
+{
+public:
+	int width, height;
+	// also store both velocity components after the density
+	bool withVelocity;
+	// buffers in the pool, bounding both memory and how far the writer may fall behind
+	int poolFrames;
+	// most frames handed to one vectored write
+	int batchFrames;
+	BackpressurePolicy policy;
+	RecorderConfig()
+		: width(SIZE), height(SIZE), withVelocity(false), poolFrames(8), batchFrames(4), policy(BACKPRESSURE_BLOCK) {}
+};
+
+// Recording file layout, little endian:
+//   RecordingHeader
+//   frames of a fixed size, each a FrameHeader followed by width * height
+//   floats of density and, with velocity, the same again for x and y
+// Fixed size frames put frame k at a known offset, so a reader can seek.
+class RecordingHeader
+{
+public:
+	char magic[8];
+	uint32_t version;
+	int32_t width, height;
+	uint32_t channels;
+	uint64_t frameBytes;
+};
+
+class FrameHeader
+{
+public:
+	// the caller's step number, so dropped frames show up as gaps
+	uint64_t step;
+	uint64_t reserved;
+};
+
+// Streams frames to disk from a background thread. record() copies the
+// frame into a free buffer from a fixed pool and queues it; the writer
+// thread takes up to batchFrames consecutive frames at a time and writes
+// them with one pwritev at their final offset. The solver thread never
+// waits on the disk unless the pool runs dry under BACKPRESSURE_BLOCK.
+class FrameRecorder
+{
+public:
+	// returns nullptr if the file cannot be created
+	static FrameRecorder* Create(const char* arg_path, const RecorderConfig& arg_config);
+	FrameRecorder(const FrameRecorder&) = delete;
+	FrameRecorder& operator=(const FrameRecorder&) = delete;
+	// writes everything still queued, then closes the file
+	~FrameRecorder();
+	// false if the frame was dropped, or the simulator's grid is not the configured one
+	bool record(const RuntimeSimulator& arg_simulator, uint64_t arg_step);
+	// row-major width * height arrays; the velocity ones are ignored without withVelocity
+	bool record(uint64_t arg_step, const float* arg_density, const float* arg_veloX, const float* arg_veloY);
+	uint64_t getWrittenFrames() const;
+	uint64_t getDroppedFrames() const;
+	// set once a write fails; later frames are discarded
+	bool hasFailed() const;
+
+private:
+	class QueuedFrame
+	{
+	public:
+		int slot;
+		uint64_t index;
+	};
+
+	RecorderConfig config;
+	size_t frameBytes;
+	std::vector<char> pool;
+	std::deque<int> freeSlots;
+	std::deque<QueuedFrame> queued;
+	uint64_t nextIndex;
+	uint64_t written, dropped;
+	bool failed, stopping;
+	mutable std::mutex mutex;
+	std::condition_variable frameQueued, slotFreed;
+	std::thread writer;
+	// a HANDLE on Windows, a descriptor elsewhere
+	intptr_t file;
+
+	FrameRecorder(const RecorderConfig& arg_config, intptr_t arg_file);
+	// a free slot, or -1 when dropping
+	int acquireSlot();
+	void queueSlot(int arg_slot);
+	void runWriter();
+	bool writeBatch(const std::vector<QueuedFrame>& arg_batch);
+	char* slotData(int arg_slot) { return pool.data() + arg_slot * frameBytes; }
+};
+
+#endif
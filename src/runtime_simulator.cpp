@@ -0,0 +1,213 @@
+#include "runtime_simulator.h"
+#include "simulator.h"
+#include <glm/glm.hpp>
+
+template <typename Simulator>
+class RuntimeSimulatorImpl : public RuntimeSimulator
+{
+public:
+	typedef typename Simulator::Cell Cell;
+	typedef typename Simulator::Storage Storage;
+	typedef typename Simulator::Compute Compute;
+
+	Cell cell;
+	Simulator simulator;
+
+	RuntimeSimulatorImpl(const SimulatorConfig& arg_config)
+		: cell(arg_config.diffusion, arg_config.viscocity, arg_config.dt, arg_config.width, arg_config.height,
+			arg_config.cellSizeX, arg_config.cellSizeY),
+		simulator(&cell, arg_config.iterations)
+	{
+		config = arg_config;
+		simulator.ACTIVITY.setEnabled(arg_config.trackActivity);
+	}
+
+	void step() override
+	{
+		simulator.step();
+	}
+
+	int advance(float arg_frameTime) override
+	{
+		return simulator.advance(arg_frameTime, config.cfl, config.maxSubsteps);
+	}
+
+	float getTimestep() const override { return (float)cell.dt; }
+
+	void addDye(int arg_posX, int arg_posY, float arg_amount) override
+	{
+		simulator.addDye(arg_posX, arg_posY, arg_amount);
+	}
+
+	void addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY) override
+	{
+		simulator.addVelocity(arg_posX, arg_posY, arg_amountX, arg_amountY);
+	}
+
+	void fadeDensity(float arg_amount) override
+	{
+		Storage* density = cell.density.current;
+		for (int j = 0; j < cell.height; j++) {
+			for (int i = 0; i < cell.width; i++) {
+				int index = simulator.GenerateIndex(i, j);
+				Compute value = Compute(density[index]) - Compute(arg_amount);
+				density[index] = Storage(value > Compute(0) ? value : Compute(0));
+			}
+		}
+	}
+
+	void readDensity(float* arg_out) const override
+	{
+		const Storage* density = cell.density.current;
+		for (int j = 0; j < cell.height; j++) {
+			for (int i = 0; i < cell.width; i++) {
+				*arg_out++ = (float)density[simulator.GenerateIndex(i, j)];
+			}
+		}
+	}
+
+	void readVelocity(float* arg_outX, float* arg_outY) const override
+	{
+		const Storage* vx = cell.velocityX.current;
+		const Storage* vy = cell.velocityY.current;
+		for (int j = 0; j < cell.height; j++) {
+			for (int i = 0; i < cell.width; i++) {
+				int index = simulator.GenerateIndex(i, j);
+				*arg_outX++ = (float)vx[index];
+				*arg_outY++ = (float)vy[index];
+			}
+		}
+	}
+
+	void writeState(const float* arg_density, const float* arg_veloX, const float* arg_veloY) override
+	{
+		Storage* density = cell.density.current;
+		Storage* vx = cell.velocityX.current;
+		Storage* vy = cell.velocityY.current;
+		Compute maxSpeed = 0;
+		for (int j = 0; j < cell.height; j++) {
+			for (int i = 0; i < cell.width; i++) {
+				int index = simulator.GenerateIndex(i, j);
+				density[index] = Storage(*arg_density++);
+				vx[index] = Storage(*arg_veloX);
+				vy[index] = Storage(*arg_veloY);
+				maxSpeed = glm::max(maxSpeed, glm::max(glm::abs(Compute(*arg_veloX++)) / cell.cellSizeX, glm::abs(Compute(*arg_veloY++)) / cell.cellSizeY));
+			}
+		}
+		simulator.MAX_CELL_SPEED = maxSpeed;
+		// any tile may hold fluid now
+		simulator.ACTIVITY.setEnabled(simulator.ACTIVITY.enabled);
+	}
+
+	int getWidth() const override { return cell.width; }
+	int getHeight() const override { return cell.height; }
+	int getIterations() const override { return simulator.NUM_ITERATIONS; }
+	void setParameters(float arg_diffusion, float arg_viscocity, float arg_dt) override
+	{
+		cell.diffusion = Compute(arg_diffusion);
+		cell.viscocity = Compute(arg_viscocity);
+		cell.dt = Compute(arg_dt);
+		config.diffusion = arg_diffusion;
+		config.viscocity = arg_viscocity;
+		config.dt = arg_dt;
+	}
+	void setIterations(int arg_iterations) override
+	{
+		simulator.NUM_ITERATIONS = arg_iterations;
+		config.iterations = arg_iterations;
+	}
+	void setActivityTracking(bool arg_enabled) override
+	{
+		simulator.ACTIVITY.setEnabled(arg_enabled);
+		config.trackActivity = arg_enabled;
+	}
+	float getActiveFraction() const override { return simulator.ACTIVITY.activeFraction(); }
+};
+
+// Each helper resolves one policy from the config and hands the rest of the
+// choice to the next one, ending in a concrete FluidSimulator instantiation
+
+template <typename Solver, typename Advector, typename Boundary>
+static RuntimeSimulator* CreateWithLayout(const SimulatorConfig& arg_config)
+{
+	switch (arg_config.layout) {
+	case LAYOUT_ROW_MAJOR:
+		return new RuntimeSimulatorImpl<FluidSimulator<Solver, Advector, Boundary, RowMajorLayout>>(arg_config);
+	case LAYOUT_TILED_8:
+		return new RuntimeSimulatorImpl<FluidSimulator<Solver, Advector, Boundary, TiledLayout<8>>>(arg_config);
+	case LAYOUT_TILED_16:
+		return new RuntimeSimulatorImpl<FluidSimulator<Solver, Advector, Boundary, TiledLayout<16>>>(arg_config);
+	case LAYOUT_MORTON:
+		return new RuntimeSimulatorImpl<FluidSimulator<Solver, Advector, Boundary, MortonLayout>>(arg_config);
+	}
+	return nullptr;
+}
+
+template <typename Solver, typename Advector>
+static RuntimeSimulator* CreateWithBoundary(const SimulatorConfig& arg_config)
+{
+	switch (arg_config.boundary) {
+	case BOUNDARY_BOX:
+		return CreateWithLayout<Solver, Advector, BoxBoundary>(arg_config);
+	case BOUNDARY_PERIODIC:
+		return CreateWithLayout<Solver, Advector, PeriodicBoundary>(arg_config);
+	}
+	return nullptr;
+}
+
+template <typename Solver>
+static RuntimeSimulator* CreateWithAdvector(const SimulatorConfig& arg_config)
+{
+	switch (arg_config.advector) {
+	case ADVECTOR_BILINEAR:
+		return CreateWithBoundary<Solver, BilinearAdvector>(arg_config);
+	case ADVECTOR_NEAREST:
+		return CreateWithBoundary<Solver, NearestAdvector>(arg_config);
+	}
+	return nullptr;
+}
+
+static bool UsesDefaultPolicies(const SimulatorConfig& arg_config)
+{
+	return arg_config.solver == SOLVER_GAUSS_SEIDEL && arg_config.advector == ADVECTOR_BILINEAR
+		&& arg_config.boundary == BOUNDARY_BOX && arg_config.layout == LAYOUT_ROW_MAJOR;
+}
+
+bool RuntimeSimulator::IsSupported(const SimulatorConfig& arg_config)
+{
+	bool known = arg_config.solver >= SOLVER_GAUSS_SEIDEL && arg_config.solver <= SOLVER_RED_BLACK
+		&& arg_config.advector >= ADVECTOR_BILINEAR && arg_config.advector <= ADVECTOR_NEAREST
+		&& arg_config.boundary >= BOUNDARY_BOX && arg_config.boundary <= BOUNDARY_PERIODIC
+		&& arg_config.layout >= LAYOUT_ROW_MAJOR && arg_config.layout <= LAYOUT_MORTON
+		&& arg_config.precision >= PRECISION_FLOAT && arg_config.precision <= PRECISION_BFLOAT16;
+	return known && (arg_config.precision == PRECISION_FLOAT || UsesDefaultPolicies(arg_config));
+}
+
+RuntimeSimulator* RuntimeSimulator::Create(const SimulatorConfig& arg_config)
+{
+	if (arg_config.precision != PRECISION_FLOAT)
+	{
+		if (!UsesDefaultPolicies(arg_config))
+		{
+			return nullptr;
+		}
+		switch (arg_config.precision) {
+		case PRECISION_DOUBLE:
+			return new RuntimeSimulatorImpl<FluidSimulator<GaussSeidelSolver, BilinearAdvector, BoxBoundary, RowMajorLayout, DoublePrecision>>(arg_config);
+		case PRECISION_HALF:
+			return new RuntimeSimulatorImpl<FluidSimulator<GaussSeidelSolver, BilinearAdvector, BoxBoundary, RowMajorLayout, HalfPrecision>>(arg_config);
+		case PRECISION_BFLOAT16:
+			return new RuntimeSimulatorImpl<FluidSimulator<GaussSeidelSolver, BilinearAdvector, BoxBoundary, RowMajorLayout, BFloat16Precision>>(arg_config);
+		default:
+			return nullptr;
+		}
+	}
+
+	switch (arg_config.solver) {
+	case SOLVER_GAUSS_SEIDEL:
+		return CreateWithAdvector<GaussSeidelSolver>(arg_config);
+	case SOLVER_RED_BLACK:
+		return CreateWithAdvector<RedBlackSolver>(arg_config);
+	}
+	return nullptr;
+}
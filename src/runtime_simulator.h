@@ -0,0 +1,78 @@
+#pragma once
+#ifndef RUNTIME_SIMULATOR_H
+#define RUNTIME_SIMULATOR_H
+#include "fluid.h"
+
+enum SolverKind { SOLVER_GAUSS_SEIDEL, SOLVER_RED_BLACK };
+enum AdvectorKind { ADVECTOR_BILINEAR, ADVECTOR_NEAREST };
+enum BoundaryKind { BOUNDARY_BOX, BOUNDARY_PERIODIC };
+enum LayoutKind { LAYOUT_ROW_MAJOR, LAYOUT_TILED_8, LAYOUT_TILED_16, LAYOUT_MORTON };
+enum PrecisionKind { PRECISION_FLOAT, PRECISION_DOUBLE, PRECISION_HALF, PRECISION_BFLOAT16 };
+
+class SimulatorConfig
+{
+public:
+	int width, height;
+	// spacing between cell centres, 0 picks square cells spanning a unit long side
+	float cellSizeX, cellSizeY;
+	int iterations;
+	float diffusion, viscocity, dt;
+	SolverKind solver;
+	AdvectorKind advector;
+	BoundaryKind boundary;
+	LayoutKind layout;
+	// anything but float is only available with the default policies
+	PrecisionKind precision;
+	// skip quiescent tiles, an approximation, see ActivityMap
+	bool trackActivity;
+	// advance() keeps every substep under cfl cells of motion, using at most maxSubsteps per frame
+	float cfl;
+	int maxSubsteps;
+	SimulatorConfig()
+		: width(SIZE), height(SIZE), cellSizeX(0.0f), cellSizeY(0.0f), iterations(16), diffusion(0.2f), viscocity(0.01f), dt(0.000005f),
+		solver(SOLVER_GAUSS_SEIDEL), advector(ADVECTOR_BILINEAR), boundary(BOUNDARY_BOX),
+		layout(LAYOUT_ROW_MAJOR), precision(PRECISION_FLOAT), trackActivity(false), cfl(2.0f), maxSubsteps(8) {}
+};
+
+// Type-erased handle on a FluidCell and the FluidSimulator instantiation
+// chosen by a SimulatorConfig. Only whole-step and per-injection calls go
+// through the virtual interface; the kernels run fully specialized.
+class RuntimeSimulator
+{
+public:
+	virtual ~RuntimeSimulator() {}
+	virtual void step() = 0;
+	// simulates arg_frameTime in CFL-limited substeps, returns how many were taken
+	virtual int advance(float arg_frameTime) = 0;
+	// dt of the last step taken
+	virtual float getTimestep() const = 0;
+	virtual void addDye(int arg_posX, int arg_posY, float arg_amount) = 0;
+	virtual void addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY) = 0;
+	// lowers every density value by arg_amount, clamping at zero
+	virtual void fadeDensity(float arg_amount) = 0;
+	// writes the density as width * height floats, row by row
+	virtual void readDensity(float* arg_out) const = 0;
+	virtual void readVelocity(float* arg_outX, float* arg_outY) const = 0;
+	// replaces density and velocity with width * height row-major arrays
+	virtual void writeState(const float* arg_density, const float* arg_veloX, const float* arg_veloY) = 0;
+	virtual int getWidth() const = 0;
+	virtual int getHeight() const = 0;
+	virtual int getIterations() const = 0;
+	// takes effect from the next step; advance() still picks its own dt per substep
+	virtual void setParameters(float arg_diffusion, float arg_viscocity, float arg_dt) = 0;
+	virtual void setIterations(int arg_iterations) = 0;
+	virtual void setActivityTracking(bool arg_enabled) = 0;
+	// share of the grid the kernels visited in the last step
+	virtual float getActiveFraction() const = 0;
+	const SimulatorConfig& getConfig() const { return config; }
+
+	// returns nullptr if the combination in arg_config is not instantiated
+	static RuntimeSimulator* Create(const SimulatorConfig& arg_config);
+	// whether Create() instantiates the kinds in arg_config
+	static bool IsSupported(const SimulatorConfig& arg_config);
+
+protected:
+	SimulatorConfig config;
+};
+
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+#ifndef SELFCHECK_H
+#define SELFCHECK_H
+#include <ostream>
+
+// Invariants the simulators promise, checked without a window by
+// --self-check. Each check writes one line to arg_log and returns false if
+// its invariant does not hold.
+
+// dye diffusing across the edge of refined patches keeps its total
+bool CheckAdaptiveConservesDye(std::ostream& arg_log);
+
+// every lane of an EnsembleSimulator matches a FluidSimulator fed the same input
+bool CheckEnsembleMatchesScalar(std::ostream& arg_log);
+
+// runs every check, returns how many failed
+int RunSelfChecks(std::ostream& arg_log);
+
+#endif
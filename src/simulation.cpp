@@ -1,6 +1,7 @@
 #include "common.h"
-#include "fluid.h"
-#include "simulator.h"
+#include "quality.h"
+#include "input_log.h"
+#include "upload_ring.h"
 #include <iostream>
 #include <chrono>
 #include <cassert>
@@ -19,53 +20,82 @@ typedef glm::vec3 vec3;
 
 const int window_size = 512;
 const int N = SIZE;
-const int NumVertices = N * N * 4;
-const int NumIndices = N * N * 6;
-point4 vertices[NumVertices];
-const int FillIndices = (2 + N * 2) * (N - 1);
-const int EdgeIndices = N * N * 2;
-GLuint indices[NumIndices];
 int prev_mouseX = 0;
 int prev_mouseY = 0;
 bool isLeftClicked = false;
 
 void fade();
 void renderFluid();
+void allocateDensityTexture();
+void selectUploadMode(UploadMode mode);
 
-FluidCell* activeCell;
-FluidSimulator* activeSimulator;
+QualityController* activeSimulator;
+float densityValues[N * N];
+
+// the density is drawn from a single-channel texture on one full-screen quad
+GLuint densityTexture;
+// GL_NEAREST draws every cell as a flat square, GL_LINEAR blends neighbours
+GLint densityFilter = GL_NEAREST;
+// upload 8-bit alpha instead of floats, a quarter of the bytes per frame
+bool byteUpload = false;
+unsigned char densityBytes[N * N];
+// the texture is filled from mapped buffer memory unless this is UPLOAD_DIRECT
+UploadMode uploadMode = UPLOAD_PERSISTENT;
+UploadRing* uploadRing = nullptr;
+const char* UPLOAD_MODE_NAMES[] = { "direct", "orphaned buffer", "persistent mapped" };
+
+const char* inputRecordPath = nullptr;
+const char* inputReplayPath = nullptr;
+InputRecorder* inputRecorder = nullptr;
+InputReplay* inputReplay = nullptr;
+// frames advanced so far, the frame the next injections belong to
+int frameNumber = 0;
+double totalStepMs = 0.0;
+
+void recordInput(const char* path)
+{
+	inputRecordPath = path;
+}
+
+void replayInput(const char* path)
+{
+	inputReplayPath = path;
+}
 
 //----------------------------------------------------------------------------
 
 // OpenGL initialization
 void init() {
-	//create a new fluid cell
-	activeCell = new FluidCell(0.2f, 0.01f, 0.000005f);
-	activeSimulator = new FluidSimulator(activeCell, 16);
-
-	// create the height field vertices (a 2D grid in the x-z plane)
-	int Index = 0;
-	int FaceIndex = 0;
-	float dx = 2.0f / N, dy = 2.0f / N;
-
-	for (int i = 0; i < N; i++) {
-		float y = i * dy - 1.0f;
-		for (int j = 0; j < N; j++) {
-			float x = j * dx - 1.0f;
-			vertices[Index++] = point4(x, y, 1.0, 1.0); 
-			vertices[Index++] = point4(x + dx, y, 1.0, 1.0); 
-			vertices[Index++] = point4(x + dx, y + dy, 1.0, 1.0); 
-			vertices[Index++] = point4(x, y + dy, 1.0, 1.0); 
-			indices[FaceIndex++] = Index - 4;
-			indices[FaceIndex++] = Index - 3;
-			indices[FaceIndex++] = Index - 1;
-			indices[FaceIndex++] = Index - 3;
-			indices[FaceIndex++] = Index - 2;
-			indices[FaceIndex++] = Index - 1;
+	//create a new fluid cell and its simulator, see SimulatorConfig for the policy choices
+	SimulatorConfig config;
+	config.width = N;
+	config.height = N;
+	if (inputReplayPath)
+	{
+		inputReplay = InputReplay::Open(inputReplayPath);
+		if (!inputReplay || inputReplay->getConfig().width != N || inputReplay->getConfig().height != N)
+		{
+			std::cerr << "Cannot replay " << inputReplayPath << std::endl;
+			exit(EXIT_FAILURE);
 		}
+		config = inputReplay->getConfig();
 	}
-	assert(Index == NumVertices);
-	assert(FaceIndex == NumIndices);
+	// the step gets the whole frame budget, the controller leaves headroom for drawing
+	activeSimulator = new QualityController(config, FRAME_RATE_MS);
+	// a replay takes its level switches from the log, not from this machine's timing
+	activeSimulator->adaptive = !inputReplay;
+	if (inputRecordPath)
+	{
+		inputRecorder = InputRecorder::Create(inputRecordPath, config);
+		if (!inputRecorder)
+		{
+			std::cerr << "Cannot record to " << inputRecordPath << std::endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// one quad covering the window, the texture supplies a value per cell
+	point4 quad[4] = { point4(-1.0, -1.0, 0.0, 1.0), point4(1.0, -1.0, 0.0, 1.0), point4(-1.0, 1.0, 0.0, 1.0), point4(1.0, 1.0, 0.0, 1.0) };
 
 	GLuint vao;
 	glGenVertexArrays(1, &vao);
@@ -75,13 +105,7 @@ void init() {
 	GLuint buffer;
 	glGenBuffers(1, &buffer);
 	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), NULL, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-
-	// Index buffer
-	glGenBuffers(1, &buffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
 
 	// Load shaders and use the resulting shader program
 	GLuint program = InitShader("vshader.glsl", "fshader.glsl");
@@ -92,10 +116,20 @@ void init() {
 	glEnableVertexAttribArray(vPosition);
 	glVertexAttribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
 
-	glEnable(GL_DEPTH_TEST);
+	glGenTextures(1, &densityTexture);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, densityTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	// rows of 8-bit texels are not 4-byte aligned for every N
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	allocateDensityTexture();
+	selectUploadMode(uploadMode);
+	glUniform1i(glGetUniformLocation(program, "density"), 0);
+
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glShadeModel(GL_FLAT);
 	glClearColor(0.0, 0.0, 0.0, 1.0);
 }
 
@@ -103,10 +137,38 @@ void init() {
 
 void display(void) {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	activeSimulator->step();
+	if (inputReplay)
+	{
+		if (frameNumber == inputReplay->getFrameCount())
+		{
+			std::cout << "replayed " << frameNumber << " frames, " << totalStepMs / glm::max(frameNumber, 1) << " ms per step" << std::endl;
+			exit(EXIT_SUCCESS);
+		}
+		inputReplay->applyFrame(frameNumber, *activeSimulator);
+	}
+	// one frame covers the configured dt, split into substeps while stirring is violent
+	int level = activeSimulator->getLevel();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	activeSimulator->advance(activeSimulator->getSimulator()->getConfig().dt);
+	totalStepMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	frameNumber++;
+	if (inputRecorder)
+	{
+		inputRecorder->nextFrame();
+	}
+	if (activeSimulator->getLevel() != level)
+	{
+		// the switch lands before the next frame's injections, the replay applies it there
+		if (inputRecorder)
+		{
+			inputRecorder->setLevel(activeSimulator->getLevel());
+		}
+		std::string status = activeSimulator->describe();
+		std::cout << status << std::endl;
+		glutSetWindowTitle((std::string(WINDOW_TITLE) + " - " + status).c_str());
+	}
 	renderFluid();
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-	glDrawElements(GL_TRIANGLES, NumVertices * 3 / 2, GL_UNSIGNED_INT, 0);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 	glutSwapBuffers();
 }
 
@@ -143,48 +205,119 @@ void keyboard(unsigned char key, int x, int y) {
 	switch (key) {
 	case 033: // Escape Key
 	case 'q': case 'Q':
+		if (inputRecorder && !inputRecorder->close())
+		{
+			std::cerr << "Input recording incomplete" << std::endl;
+		}
 		exit(EXIT_SUCCESS);
 		break;
+	case 'f': case 'F':
+		densityFilter = densityFilter == GL_NEAREST ? GL_LINEAR : GL_NEAREST;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, densityFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, densityFilter);
+		std::cout << (densityFilter == GL_NEAREST ? "nearest" : "linear") << " filtering" << std::endl;
+		break;
+	case 'b': case 'B':
+		byteUpload = !byteUpload;
+		allocateDensityTexture();
+		std::cout << (byteUpload ? "8-bit" : "float") << " density upload" << std::endl;
+		break;
+	case 'u': case 'U':
+		selectUploadMode(uploadMode == UPLOAD_DIRECT ? UPLOAD_PERSISTENT : (UploadMode)(uploadMode - 1));
+		break;
 	}
 }
 
 void mouseDrag(int x, int y)
 {
+	// a replay owns every injection
+	if (inputReplay)
+	{
+		return;
+	}
 	if (x < window_size && y < window_size && x > 0 && y > 0)
 	{
 		int x_adjCoord = (x * N / window_size);
 		int y_adjCoord = (window_size - y) * N / window_size;
 		activeSimulator->addDye(y_adjCoord, x_adjCoord, 50.0f);
 		activeSimulator->addVelocity(y_adjCoord, x_adjCoord, -(y - prev_mouseY) * 10000, (x - prev_mouseX) * 10000);
+		if (inputRecorder)
+		{
+			inputRecorder->addDye(y_adjCoord, x_adjCoord, 50.0f);
+			inputRecorder->addVelocity(y_adjCoord, x_adjCoord, -(y - prev_mouseY) * 10000, (x - prev_mouseX) * 10000);
+		}
 		prev_mouseX = x;
 		prev_mouseY = y;
 	}
 }
 
-void renderFluid()
+// (Re)creates the density texture storage for the current upload format
+void allocateDensityTexture()
 {
-	int Index = 0;
-	for (int i = 0; i < N; i++)
+	if (byteUpload)
 	{
-		for (int j = 0; j < N; j++)
-		{
-			float transferVal = activeCell->density[activeSimulator->GenerateIndex(i, j)];
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, N, N, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+	}
+	else
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, N, N, 0, GL_RED, GL_FLOAT, NULL);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, densityFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, densityFilter);
+}
 
-			// all four vertices of this cell should have the same value
-			vertices[Index++].z = glm::min(transferVal, 0.99f);
-			vertices[Index++].z = glm::min(transferVal, 0.99f);
-			vertices[Index++].z = glm::min(transferVal, 0.99f);
-			vertices[Index++].z = glm::min(transferVal, 0.99f);
+// Picks the fastest supported mode from mode down
+void selectUploadMode(UploadMode mode)
+{
+	delete uploadRing;
+	uploadRing = nullptr;
+	uploadMode = mode;
+	// three regions let the CPU fill one while the GPU may still read the other two
+	while (uploadMode != UPLOAD_DIRECT && !(uploadRing = UploadRing::Create(uploadMode, N * N * sizeof(float), 3)))
+	{
+		uploadMode = (UploadMode)(uploadMode - 1);
+	}
+	std::cout << UPLOAD_MODE_NAMES[uploadMode] << " texture upload" << std::endl;
+}
+
+// Uploads one value per cell, the fragment shader turns it into alpha
+void renderFluid()
+{
+	// the simulator writes straight into the mapped region when there is one
+	void* mapped = uploadRing ? uploadRing->map() : nullptr;
+	const GLvoid* pixels;
+	if (byteUpload)
+	{
+		activeSimulator->readDensity(densityValues);
+		unsigned char* target = mapped ? (unsigned char*)mapped : densityBytes;
+		// the shader caps alpha at 0.99 as well, so the byte range covers what is visible
+		for (int i = 0; i < N * N; i++) {
+			target[i] = (unsigned char)(glm::clamp(densityValues[i], 0.0f, 1.0f) * 255.0f + 0.5f);
 		}
+		pixels = densityBytes;
+	}
+	else
+	{
+		activeSimulator->readDensity(mapped ? (float*)mapped : densityValues);
+		pixels = densityValues;
+	}
+	if (mapped)
+	{
+		pixels = uploadRing->unmap();
+	}
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, N, N, GL_RED, byteUpload ? GL_UNSIGNED_BYTE : GL_FLOAT, pixels);
+	if (mapped)
+	{
+		uploadRing->retire();
 	}
 }
 
 void fade()
 {
-	for (int i = 0; i < N; i++) {
-		for (int j = 0; j < N; j++) {
-			activeCell->density[activeSimulator->GenerateIndex(i, j)] = glm::max(activeCell->density[activeSimulator->GenerateIndex(i, j)] - 0.05f, 0.0f);
-		}
+	activeSimulator->fadeDensity(0.05f);
+	if (inputRecorder)
+	{
+		inputRecorder->fadeDensity(0.05f);
 	}
 }
 //----------------------------------------------------------------------------
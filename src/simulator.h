@@ -1,25 +1,60 @@
-#pragma once
-#include "fluid.h"
+#pragma once
+#include "fluid.h"
+#include "policies.h"
+#include "activity.h"
 #ifndef SIMULATOR_H
 #define SIMULATOR_H
 
+// Stable fluids solver. The linear solver, advection scheme, boundary
+// handling, storage layout and stencil weights are compile-time policies (see policies.h and
+// layout.h); RuntimeSimulator wraps a chosen combination behind a virtual
+// interface for code that picks the strategies at run time.
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision = FloatPrecision, typename Stencil = ClassicStencil>
 class FluidSimulator
 {
 public:
-	int GRID_SIZE;
+	typedef typename Precision::storage_type Storage;
+	typedef typename Precision::compute_type Compute;
+	typedef FluidCell<Layout, Precision> Cell;
+
+	int GRID_WIDTH, GRID_HEIGHT;
 	int NUM_ITERATIONS;
-	FluidCell* FLUID_CELL;
-	FluidSimulator(FluidCell* arg_fluidCell, int arg_numIterations);
+	Layout LAYOUT;
+	ActivityMap ACTIVITY;
+	// largest |velocity| / spacing after the last step or injection, in cells per unit time
+	Compute MAX_CELL_SPEED;
+	Cell* FLUID_CELL;
+	FluidSimulator(Cell* arg_fluidCell, int arg_numIterations);
 	~FluidSimulator();
-	int GenerateIndex(int arg_x, int arg_y);
+	inline int GenerateIndex(int arg_x, int arg_y) const { return LAYOUT.GenerateIndex(arg_x, arg_y); }
 	void addDye(int arg_posX, int arg_posY, float arg_amount);
 	void addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY);
-	void diffuse(int b, float* arg_velocities, float* arg_velocities_prev, float arg_diff, float arg_dt);
-	void linearSolve(int b, float* arg_velocities, float* arg_velocities_prev, float a, float c);
-	void project(float* arg_veloX, float* arg_veloY, float* p, float* div);
-	void advect(int b, float* arg_dyeVal, float* arg_dyeValPrev, float* arg_veloX, float* arg_veloY, float dt);
-	void setBoundaries(int b, float* x);
+	template <int B> void diffuse(Storage* arg_velocities, Storage* arg_velocities_prev, Compute arg_diff, Compute arg_dt);
+	template <int B> void linearSolve(Storage* arg_velocities, Storage* arg_velocities_prev, Compute ax, Compute ay, Compute c)
+	{
+		Solver::template linearSolve<B>(*this, arg_velocities, arg_velocities_prev, ax, ay, c);
+	}
+	// returns the largest |velocity| / spacing of the projected field
+	Compute project(Storage* arg_veloX, Storage* arg_veloY, Storage* p, Storage* div);
+	template <int B> void advect(Storage* arg_dyeVal, Storage* arg_dyeValPrev, Storage* arg_veloX, Storage* arg_veloY, Compute dt)
+	{
+		Advector::template advect<B>(*this, arg_dyeVal, arg_dyeValPrev, arg_veloX, arg_veloY, dt);
+	}
+	template <int B> void setBoundaries(Storage* x)
+	{
+		Boundary::template apply<B>(*this, x);
+	}
+	// rescans the active tiles and clears the ones that went quiet
+	void updateActivity();
+	// activates every tile if flow of arg_cellSpeed would outrun the halo this step
+	void coverMotion(Compute arg_cellSpeed, Compute arg_dt);
+	void clearTile(int arg_tileX, int arg_tileY);
 	void step();
+	// largest dt that moves no cell more than arg_cfl cells, at most arg_maxDt
+	float stableTimestep(float arg_cfl, float arg_maxDt) const;
+	// steps through arg_frameTime in equal substeps that each satisfy arg_cfl,
+	// or in arg_maxSubsteps steps if that is not enough; returns the substeps taken
+	int advance(float arg_frameTime, float arg_cfl, int arg_maxSubsteps);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,249 @@
+#include "simulator3d.h"
+#include <cmath>
+
+template <typename Layout, typename Precision>
+FluidSimulator3D<Layout, Precision>::FluidSimulator3D(Cell* arg_fluidCell, int arg_numIterations)
+	: LAYOUT(arg_fluidCell->layout)
+{
+	FLUID_CELL = arg_fluidCell;
+	GRID_SIZE = arg_fluidCell->size;
+	NUM_ITERATIONS = arg_numIterations;
+}
+
+template <typename Layout, typename Precision>
+void FluidSimulator3D<Layout, Precision>::addDye(int arg_posX, int arg_posY, int arg_posZ, float arg_amount)
+{
+	int index = GenerateIndex(arg_posX, arg_posY, arg_posZ);
+	Storage* density = FLUID_CELL->density.current;
+	density[index] = Storage(Compute(density[index]) + arg_amount);
+}
+
+template <typename Layout, typename Precision>
+void FluidSimulator3D<Layout, Precision>::addVelocity(int arg_posX, int arg_posY, int arg_posZ, float arg_amountX, float arg_amountY, float arg_amountZ)
+{
+	int index = GenerateIndex(arg_posX, arg_posY, arg_posZ);
+	Storage* vx = FLUID_CELL->velocityX.current;
+	Storage* vy = FLUID_CELL->velocityY.current;
+	Storage* vz = FLUID_CELL->velocityZ.current;
+	vx[index] = Storage(Compute(vx[index]) + arg_amountX);
+	vy[index] = Storage(Compute(vy[index]) + arg_amountY);
+	vz[index] = Storage(Compute(vz[index]) + arg_amountZ);
+}
+
+template <typename Layout, typename Precision>
+template <int B>
+void FluidSimulator3D<Layout, Precision>::diffuse(Storage* x, Storage* x0, Compute arg_diff, Compute arg_dt)
+{
+	Compute a = arg_dt * arg_diff * (GRID_SIZE - 2) * (GRID_SIZE - 2);
+	linearSolve<B>(x, x0, a, Compute(1) + Compute(6) * a);
+}
+
+// Gauss-Seidel in red-black order: a cell never reads a neighbour updated
+// earlier in the same half sweep, which keeps the inner loop free of the
+// x[i - 1] dependency chain of a lexicographic sweep
+template <typename Layout, typename Precision>
+template <int B>
+void FluidSimulator3D<Layout, Precision>::linearSolve(Storage* x, Storage* x0, Compute a, Compute c)
+{
+	const int n = GRID_SIZE;
+	Compute cInverse = Compute(1) / c;
+	for (int k = 0; k < NUM_ITERATIONS; k++) {
+		for (int colour = 0; colour < 2; colour++) {
+			for (int m = 1; m < n - 1; m++) {
+				for (int j = 1; j < n - 1; j++) {
+					for (int i = 1 + ((j + m + colour) & 1); i < n - 1; i += 2) {
+						x[GenerateIndex(i, j, m)] = Storage((Compute(x0[GenerateIndex(i, j, m)])
+							+ a * (Compute(x[GenerateIndex(i + 1, j, m)])
+								+ Compute(x[GenerateIndex(i - 1, j, m)])
+								+ Compute(x[GenerateIndex(i, j + 1, m)])
+								+ Compute(x[GenerateIndex(i, j - 1, m)])
+								+ Compute(x[GenerateIndex(i, j, m + 1)])
+								+ Compute(x[GenerateIndex(i, j, m - 1)])
+								)) * cInverse);
+					}
+				}
+			}
+		}
+		setBoundaries<B>(x);
+	}
+}
+
+template <typename Layout, typename Precision>
+void FluidSimulator3D<Layout, Precision>::project(Storage* arg_veloX, Storage* arg_veloY, Storage* arg_veloZ, Storage* p, Storage* div)
+{
+	const int n = GRID_SIZE;
+	for (int m = 1; m < n - 1; m++) {
+		for (int j = 1; j < n - 1; j++) {
+			for (int i = 1; i < n - 1; i++) {
+				div[GenerateIndex(i, j, m)] = Storage(Compute(-0.5f) * (
+					Compute(arg_veloX[GenerateIndex(i + 1, j, m)])
+					- Compute(arg_veloX[GenerateIndex(i - 1, j, m)])
+					+ Compute(arg_veloY[GenerateIndex(i, j + 1, m)])
+					- Compute(arg_veloY[GenerateIndex(i, j - 1, m)])
+					+ Compute(arg_veloZ[GenerateIndex(i, j, m + 1)])
+					- Compute(arg_veloZ[GenerateIndex(i, j, m - 1)])
+					) / n);
+				p[GenerateIndex(i, j, m)] = Storage(0.0f);
+			}
+		}
+	}
+	setBoundaries<0>(div);
+	setBoundaries<0>(p);
+	linearSolve<0>(p, div, 1, 6);
+
+	for (int m = 1; m < n - 1; m++) {
+		for (int j = 1; j < n - 1; j++) {
+			for (int i = 1; i < n - 1; i++) {
+				int index = GenerateIndex(i, j, m);
+				arg_veloX[index] = Storage(Compute(arg_veloX[index]) - Compute(0.5f) * (Compute(p[GenerateIndex(i + 1, j, m)]) - Compute(p[GenerateIndex(i - 1, j, m)])) * n);
+				arg_veloY[index] = Storage(Compute(arg_veloY[index]) - Compute(0.5f) * (Compute(p[GenerateIndex(i, j + 1, m)]) - Compute(p[GenerateIndex(i, j - 1, m)])) * n);
+				arg_veloZ[index] = Storage(Compute(arg_veloZ[index]) - Compute(0.5f) * (Compute(p[GenerateIndex(i, j, m + 1)]) - Compute(p[GenerateIndex(i, j, m - 1)])) * n);
+			}
+		}
+	}
+	setBoundaries<1>(arg_veloX);
+	setBoundaries<2>(arg_veloY);
+	setBoundaries<3>(arg_veloZ);
+}
+
+template <typename Layout, typename Precision>
+template <int B>
+void FluidSimulator3D<Layout, Precision>::advect(Storage* d, Storage* d0, Storage* arg_veloX, Storage* arg_veloY, Storage* arg_veloZ, Compute dt)
+{
+	const int n = GRID_SIZE;
+	Compute dtScaled = dt * (n - 2);
+	Compute maxCoord = Compute(n) - Compute(1.5f);
+
+	for (int m = 1; m < n - 1; m++) {
+		for (int j = 1; j < n - 1; j++) {
+			for (int i = 1; i < n - 1; i++) {
+				int index = GenerateIndex(i, j, m);
+				Compute x = Compute(i) - dtScaled * Compute(arg_veloX[index]);
+				Compute y = Compute(j) - dtScaled * Compute(arg_veloY[index]);
+				Compute z = Compute(m) - dtScaled * Compute(arg_veloZ[index]);
+				if (x < Compute(0.5f)) x = Compute(0.5f);
+				if (x > maxCoord) x = maxCoord;
+				if (y < Compute(0.5f)) y = Compute(0.5f);
+				if (y > maxCoord) y = maxCoord;
+				if (z < Compute(0.5f)) z = Compute(0.5f);
+				if (z > maxCoord) z = maxCoord;
+				Compute i0 = std::floor(x);
+				Compute j0 = std::floor(y);
+				Compute k0 = std::floor(z);
+				Compute s1 = x - i0;
+				Compute s0 = Compute(1) - s1;
+				Compute t1 = y - j0;
+				Compute t0 = Compute(1) - t1;
+				Compute u1 = z - k0;
+				Compute u0 = Compute(1) - u1;
+
+				int i0i = (int)i0;
+				int j0i = (int)j0;
+				int k0i = (int)k0;
+
+				d[index] = Storage(
+					s0 * (t0 * (u0 * Compute(d0[GenerateIndex(i0i, j0i, k0i)]) + u1 * Compute(d0[GenerateIndex(i0i, j0i, k0i + 1)]))
+						+ t1 * (u0 * Compute(d0[GenerateIndex(i0i, j0i + 1, k0i)]) + u1 * Compute(d0[GenerateIndex(i0i, j0i + 1, k0i + 1)])))
+					+ s1 * (t0 * (u0 * Compute(d0[GenerateIndex(i0i + 1, j0i, k0i)]) + u1 * Compute(d0[GenerateIndex(i0i + 1, j0i, k0i + 1)]))
+						+ t1 * (u0 * Compute(d0[GenerateIndex(i0i + 1, j0i + 1, k0i)]) + u1 * Compute(d0[GenerateIndex(i0i + 1, j0i + 1, k0i + 1)]))));
+			}
+		}
+	}
+	setBoundaries<B>(d);
+}
+
+template <typename Layout, typename Precision>
+template <int B>
+void FluidSimulator3D<Layout, Precision>::setBoundaries(Storage* x)
+{
+	const int n = GRID_SIZE;
+	for (int j = 1; j < n - 1; j++) {
+		for (int i = 1; i < n - 1; i++) {
+			x[GenerateIndex(i, j, 0)] = B == 3 ? Storage(-Compute(x[GenerateIndex(i, j, 1)])) : x[GenerateIndex(i, j, 1)];
+			x[GenerateIndex(i, j, n - 1)] = B == 3 ? Storage(-Compute(x[GenerateIndex(i, j, n - 2)])) : x[GenerateIndex(i, j, n - 2)];
+		}
+	}
+	for (int m = 1; m < n - 1; m++) {
+		for (int i = 1; i < n - 1; i++) {
+			x[GenerateIndex(i, 0, m)] = B == 2 ? Storage(-Compute(x[GenerateIndex(i, 1, m)])) : x[GenerateIndex(i, 1, m)];
+			x[GenerateIndex(i, n - 1, m)] = B == 2 ? Storage(-Compute(x[GenerateIndex(i, n - 2, m)])) : x[GenerateIndex(i, n - 2, m)];
+		}
+	}
+	for (int m = 1; m < n - 1; m++) {
+		for (int j = 1; j < n - 1; j++) {
+			x[GenerateIndex(0, j, m)] = B == 1 ? Storage(-Compute(x[GenerateIndex(1, j, m)])) : x[GenerateIndex(1, j, m)];
+			x[GenerateIndex(n - 1, j, m)] = B == 1 ? Storage(-Compute(x[GenerateIndex(n - 2, j, m)])) : x[GenerateIndex(n - 2, j, m)];
+		}
+	}
+
+	// each edge averages the two face ghosts beside it, as the 2D corners do
+	const int last = n - 1;
+	for (int c = 0; c < 4; c++) {
+		int lo = (c & 1) * last, hi = (c >> 1) * last;
+		int dlo = lo ? -1 : 1, dhi = hi ? -1 : 1;
+		for (int k = 1; k < n - 1; k++) {
+			// along i, at j = lo and m = hi
+			x[GenerateIndex(k, lo, hi)] = Storage((Compute(x[GenerateIndex(k, lo + dlo, hi)]) + Compute(x[GenerateIndex(k, lo, hi + dhi)])) / Compute(2));
+			// along j, at i = lo and m = hi
+			x[GenerateIndex(lo, k, hi)] = Storage((Compute(x[GenerateIndex(lo + dlo, k, hi)]) + Compute(x[GenerateIndex(lo, k, hi + dhi)])) / Compute(2));
+			// along m, at i = lo and j = hi
+			x[GenerateIndex(lo, hi, k)] = Storage((Compute(x[GenerateIndex(lo + dlo, hi, k)]) + Compute(x[GenerateIndex(lo, hi + dhi, k)])) / Compute(2));
+		}
+	}
+
+	// then each corner averages the three edge cells beside it
+	for (int cz = 0; cz < 2; cz++) {
+		for (int cy = 0; cy < 2; cy++) {
+			for (int cx = 0; cx < 2; cx++) {
+				int i = cx * last, j = cy * last, m = cz * last;
+				int di = cx ? -1 : 1, dj = cy ? -1 : 1, dm = cz ? -1 : 1;
+				x[GenerateIndex(i, j, m)] = Storage((Compute(x[GenerateIndex(i + di, j, m)])
+					+ Compute(x[GenerateIndex(i, j + dj, m)])
+					+ Compute(x[GenerateIndex(i, j, m + dm)])) / Compute(3));
+			}
+		}
+	}
+}
+
+template <typename Layout, typename Precision>
+void FluidSimulator3D<Layout, Precision>::step()
+{
+	Compute visc = FLUID_CELL->viscocity;
+	Compute diff = FLUID_CELL->diffusion;
+	Compute dt = FLUID_CELL->dt;
+	FluidField<Storage>& vx = FLUID_CELL->velocityX;
+	FluidField<Storage>& vy = FLUID_CELL->velocityY;
+	FluidField<Storage>& vz = FLUID_CELL->velocityZ;
+	FluidField<Storage>& density = FLUID_CELL->density;
+	Storage* p = FLUID_CELL->pressure;
+	Storage* div = FLUID_CELL->divergence;
+
+	diffuse<1>(vx.previous, vx.current, visc, dt);
+	diffuse<2>(vy.previous, vy.current, visc, dt);
+	diffuse<3>(vz.previous, vz.current, visc, dt);
+	vx.swap();
+	vy.swap();
+	vz.swap();
+
+	project(vx.current, vy.current, vz.current, p, div);
+
+	advect<1>(vx.previous, vx.current, vx.current, vy.current, vz.current, dt);
+	advect<2>(vy.previous, vy.current, vx.current, vy.current, vz.current, dt);
+	advect<3>(vz.previous, vz.current, vx.current, vy.current, vz.current, dt);
+	vx.swap();
+	vy.swap();
+	vz.swap();
+
+	project(vx.current, vy.current, vz.current, p, div);
+
+	diffuse<0>(density.previous, density.current, diff, dt);
+	density.swap();
+	advect<0>(density.previous, density.current, vx.current, vy.current, vz.current, dt);
+	density.swap();
+}
+
+template class FluidSimulator3D<RowMajorLayout3D>;
+template class FluidSimulator3D<TiledLayout3D<4>>;
+template class FluidSimulator3D<TiledLayout3D<8>>;
+template class FluidSimulator3D<RowMajorLayout3D, DoublePrecision>;
+template class FluidSimulator3D<RowMajorLayout3D, HalfPrecision>;
@@ -0,0 +1,34 @@
+#pragma once
+#include "fluid3d.h"
+#ifndef SIMULATOR3D_H
+#define SIMULATOR3D_H
+
+// Volumetric stable fluids: 7-point stencils, trilinear advection and a
+// closed box. Storage layout and precision are policies exactly as in the
+// 2D FluidSimulator, see layout.h and precision.h.
+template <typename Layout, typename Precision = FloatPrecision>
+class FluidSimulator3D
+{
+public:
+	typedef typename Precision::storage_type Storage;
+	typedef typename Precision::compute_type Compute;
+	typedef FluidCell3D<Layout, Precision> Cell;
+
+	int GRID_SIZE;
+	int NUM_ITERATIONS;
+	Layout LAYOUT;
+	Cell* FLUID_CELL;
+	FluidSimulator3D(Cell* arg_fluidCell, int arg_numIterations);
+	inline int GenerateIndex(int arg_x, int arg_y, int arg_z) const { return LAYOUT.GenerateIndex(arg_x, arg_y, arg_z); }
+	void addDye(int arg_posX, int arg_posY, int arg_posZ, float arg_amount);
+	void addVelocity(int arg_posX, int arg_posY, int arg_posZ, float arg_amountX, float arg_amountY, float arg_amountZ);
+	template <int B> void diffuse(Storage* x, Storage* x0, Compute arg_diff, Compute arg_dt);
+	template <int B> void linearSolve(Storage* x, Storage* x0, Compute a, Compute c);
+	void project(Storage* arg_veloX, Storage* arg_veloY, Storage* arg_veloZ, Storage* p, Storage* div);
+	template <int B> void advect(Storage* d, Storage* d0, Storage* arg_veloX, Storage* arg_veloY, Storage* arg_veloZ, Compute dt);
+	// B is 0 for scalars and 1, 2, 3 for the x, y, z velocity components
+	template <int B> void setBoundaries(Storage* x);
+	void step();
+};
+
+#endif
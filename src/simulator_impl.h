@@ -0,0 +1,282 @@
+#pragma once
+#ifndef SIMULATOR_IMPL_H
+#define SIMULATOR_IMPL_H
+#include "simulator.h"
+#include "fluid.h"
+#include <glm/glm.hpp>
+
+// Member definitions of FluidSimulator, for the translation units that
+// instantiate it: simulator.cpp for the stock policies, decomposed.cpp for
+// its slabs.
+
+// Fields are read into Compute before any arithmetic and rounded back to
+// Storage on write, so 16 bit planes still solve in float. The same holds
+// for the policies in policies.h.
+
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::FluidSimulator(Cell* arg_fluidCell, int arg_numIterations)
+	: LAYOUT(arg_fluidCell->layout), ACTIVITY(arg_fluidCell->width, arg_fluidCell->height), MAX_CELL_SPEED(0)
+{
+	FLUID_CELL = arg_fluidCell;
+	GRID_WIDTH = arg_fluidCell->width;
+	GRID_HEIGHT = arg_fluidCell->height;
+	NUM_ITERATIONS = arg_numIterations;
+}
+
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::~FluidSimulator()
+{
+	if (!FLUID_CELL)
+	{
+		free(FLUID_CELL);
+	}
+}
+
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+void FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::addDye(int arg_posX, int arg_posY, float arg_amount)
+{
+	int index = GenerateIndex(arg_posX, arg_posY);
+	Storage* density = FLUID_CELL->density.current;
+	density[index] = Storage(Compute(density[index]) + arg_amount);
+	ACTIVITY.markOccupied(arg_posX, arg_posY);
+}
+
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+void FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::addVelocity(int arg_posX, int arg_posY, float arg_amountX, float arg_amountY)
+{
+	int index = GenerateIndex(arg_posX, arg_posY);
+	Storage* vx = FLUID_CELL->velocityX.current;
+	Storage* vy = FLUID_CELL->velocityY.current;
+	vx[index] = Storage(Compute(vx[index]) + arg_amountX);
+	vy[index] = Storage(Compute(vy[index]) + arg_amountY);
+	ACTIVITY.markOccupied(arg_posX, arg_posY);
+	Compute speed = glm::max(glm::abs(Compute(vx[index])) / FLUID_CELL->cellSizeX, glm::abs(Compute(vy[index])) / FLUID_CELL->cellSizeY);
+	MAX_CELL_SPEED = glm::max(MAX_CELL_SPEED, speed);
+}
+
+// The stencils weight each axis by 1 / spacing^2. The centre weights come
+// from the Stencil policy, see policies.h.
+
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+template <int B>
+void FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::diffuse(Storage* arg_velocities, Storage* arg_velocities_prev, Compute arg_diff, Compute arg_dt)
+{
+	Compute hx = FLUID_CELL->cellSizeX;
+	Compute hy = FLUID_CELL->cellSizeY;
+	Compute ax = arg_dt * arg_diff / (hx * hx);
+	Compute ay = arg_dt * arg_diff / (hy * hy);
+	linearSolve<B>(arg_velocities, arg_velocities_prev, ax, ay, Stencil::diffusionCentre(ax, ay));
+}
+
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+typename FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::Compute FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::project(Storage* arg_veloX, Storage* arg_veloY, Storage* p, Storage* div)
+{
+	Compute hx = FLUID_CELL->cellSizeX;
+	Compute hy = FLUID_CELL->cellSizeY;
+	// pressure is solved with the axis weights normalised to average 1
+	Compute wx = Compute(1) / (hx * hx);
+	Compute wy = Compute(1) / (hy * hy);
+	Compute divScale = Compute(-2) / (wx + wy);
+	Compute ax = Compute(2) * wx / (wx + wy);
+	Compute ay = Compute(2) * wy / (wx + wy);
+	Compute halfInvHx = Compute(0.5f) / hx;
+	Compute halfInvHy = Compute(0.5f) / hy;
+
+	for (int j = 1; j < GRID_HEIGHT - 1; j++) {
+		const std::vector<CellSpan>& spans = ACTIVITY.rowSpans(j);
+		for (size_t s = 0; s < spans.size(); s++) {
+			for (int i = spans[s].begin; i < spans[s].end; i++) {
+				div[GenerateIndex(i, j)] = Storage(divScale * (
+					(Compute(arg_veloX[GenerateIndex(i + 1, j)]) - Compute(arg_veloX[GenerateIndex(i - 1, j)])) * halfInvHx
+					+ (Compute(arg_veloY[GenerateIndex(i, j + 1)]) - Compute(arg_veloY[GenerateIndex(i, j - 1)])) * halfInvHy));
+				p[GenerateIndex(i, j)] = Storage(0.0f);
+			}
+		}
+	}
+	setBoundaries<0>(div);
+	setBoundaries<0>(p);
+	linearSolve<0>(p, div, ax, ay, Stencil::pressureCentre(ax, ay));
+
+	// the speed for the CFL timestep is taken here, while the corrected
+	// velocities are still in registers, rather than in a pass of its own
+	Compute maxSpeedX = 0;
+	Compute maxSpeedY = 0;
+	for (int j = 1; j < GRID_HEIGHT - 1; j++) {
+		const std::vector<CellSpan>& spans = ACTIVITY.rowSpans(j);
+		for (size_t s = 0; s < spans.size(); s++) {
+			for (int i = spans[s].begin; i < spans[s].end; i++) {
+				int index = GenerateIndex(i, j);
+				Compute u = Compute(arg_veloX[index]) - (Compute(p[GenerateIndex(i + 1, j)]) - Compute(p[GenerateIndex(i - 1, j)])) * halfInvHx;
+				Compute v = Compute(arg_veloY[index]) - (Compute(p[GenerateIndex(i, j + 1)]) - Compute(p[GenerateIndex(i, j - 1)])) * halfInvHy;
+				arg_veloX[index] = Storage(u);
+				arg_veloY[index] = Storage(v);
+				maxSpeedX = glm::max(maxSpeedX, glm::abs(u));
+				maxSpeedY = glm::max(maxSpeedY, glm::abs(v));
+			}
+		}
+	}
+	setBoundaries<1>(arg_veloX);
+	setBoundaries<2>(arg_veloY);
+	return glm::max(maxSpeedX / hx, maxSpeedY / hy);
+}
+
+// Only tiles that were active last step (or received an injection) can hold
+// anything, since every other tile is kept at zero, so only those are scanned.
+// The largest velocity found sets the halo: a backtrace can reach that many
+// cells, and one more tile covers diffusion.
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+void FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::updateActivity()
+{
+	const int TILE = ActivityMap::TILE;
+	const Storage* vx = FLUID_CELL->velocityX.current;
+	const Storage* vy = FLUID_CELL->velocityY.current;
+	const Storage* density = FLUID_CELL->density.current;
+	Compute motionX = FLUID_CELL->dt / FLUID_CELL->cellSizeX;
+	Compute motionY = FLUID_CELL->dt / FLUID_CELL->cellSizeY;
+	Compute densityThreshold = ACTIVITY.densityThreshold;
+	Compute motionThreshold = ACTIVITY.motionThreshold;
+	Compute maxMotion = 0;
+
+	// injections since the last step are already marked as occupied
+	std::vector<unsigned char> injected = ACTIVITY.occupied;
+	ACTIVITY.beginUpdate();
+	for (int ty = 0; ty < ACTIVITY.tilesY; ty++) {
+		for (int tx = 0; tx < ACTIVITY.tilesX; tx++) {
+			if (!ACTIVITY.wasTileActive(tx, ty) && !injected[tx + ty * ACTIVITY.tilesX])
+			{
+				continue;
+			}
+			bool occupied = false;
+			int yEnd = glm::min(GRID_HEIGHT, (ty + 1) * TILE);
+			int xEnd = glm::min(GRID_WIDTH, (tx + 1) * TILE);
+			for (int j = ty * TILE; j < yEnd; j++) {
+				for (int i = tx * TILE; i < xEnd; i++) {
+					int index = GenerateIndex(i, j);
+					Compute motion = glm::max(glm::abs(Compute(vx[index])) * motionX, glm::abs(Compute(vy[index])) * motionY);
+					maxMotion = glm::max(maxMotion, motion);
+					occupied = occupied || motion > motionThreshold || glm::abs(Compute(density[index])) > densityThreshold;
+				}
+			}
+			if (occupied)
+			{
+				ACTIVITY.markOccupied(tx * TILE, ty * TILE);
+			}
+		}
+	}
+	ACTIVITY.finishUpdate(1 + (int)glm::ceil(maxMotion / TILE));
+
+	for (int ty = 0; ty < ACTIVITY.tilesY; ty++) {
+		for (int tx = 0; tx < ACTIVITY.tilesX; tx++) {
+			if (!ACTIVITY.isActive(tx, ty) && (ACTIVITY.wasTileActive(tx, ty) || injected[tx + ty * ACTIVITY.tilesX]))
+			{
+				clearTile(tx, ty);
+			}
+		}
+	}
+}
+
+// The halo was sized from the velocity at the start of the step, which a
+// projection can exceed. The tiles outside it hold zeros, so sweeping them
+// too for the rest of the step is exact; the next update scans them all.
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+void FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::coverMotion(Compute arg_cellSpeed, Compute arg_dt)
+{
+	if (ACTIVITY.enabled && arg_cellSpeed * arg_dt > Compute(ACTIVITY.coveredMotion))
+	{
+		ACTIVITY.activateAll();
+	}
+}
+
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+void FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::clearTile(int arg_tileX, int arg_tileY)
+{
+	const int TILE = ActivityMap::TILE;
+	Storage* planes[8] = {
+		FLUID_CELL->velocityX.current, FLUID_CELL->velocityX.previous,
+		FLUID_CELL->velocityY.current, FLUID_CELL->velocityY.previous,
+		FLUID_CELL->density.current, FLUID_CELL->density.previous,
+		FLUID_CELL->pressure, FLUID_CELL->divergence
+	};
+	int yEnd = glm::min(GRID_HEIGHT, (arg_tileY + 1) * TILE);
+	int xEnd = glm::min(GRID_WIDTH, (arg_tileX + 1) * TILE);
+	for (int plane = 0; plane < 8; plane++) {
+		for (int j = arg_tileY * TILE; j < yEnd; j++) {
+			for (int i = arg_tileX * TILE; i < xEnd; i++) {
+				planes[plane][GenerateIndex(i, j)] = Storage(0.0f);
+			}
+		}
+	}
+}
+
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+void FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::step()
+{
+	Compute visc = FLUID_CELL->viscocity;
+	Compute diff = FLUID_CELL->diffusion;
+	Compute dt = FLUID_CELL->dt;
+	FluidField<Storage>& vx = FLUID_CELL->velocityX;
+	FluidField<Storage>& vy = FLUID_CELL->velocityY;
+	FluidField<Storage>& density = FLUID_CELL->density;
+	Storage* p = FLUID_CELL->pressure;
+	Storage* div = FLUID_CELL->divergence;
+
+	if (ACTIVITY.enabled)
+	{
+		updateActivity();
+	}
+
+	// every phase writes into the previous plane of its field and swaps,
+	// so no phase copies data and the pressure scratch never aliases velocity
+	diffuse<1>(vx.previous, vx.current, visc, dt);
+	diffuse<2>(vy.previous, vy.current, visc, dt);
+	vx.swap();
+	vy.swap();
+
+	coverMotion(project(vx.current, vy.current, p, div), dt);
+
+	advect<1>(vx.previous, vx.current, vx.current, vy.current, dt);
+	advect<2>(vy.previous, vy.current, vx.current, vy.current, dt);
+	vx.swap();
+	vy.swap();
+
+	MAX_CELL_SPEED = project(vx.current, vy.current, p, div);
+	coverMotion(MAX_CELL_SPEED, dt);
+
+	diffuse<0>(density.previous, density.current, diff, dt);
+	density.swap();
+	advect<0>(density.previous, density.current, vx.current, vy.current, dt);
+	density.swap();
+}
+
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+float FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::stableTimestep(float arg_cfl, float arg_maxDt) const
+{
+	if (MAX_CELL_SPEED * arg_maxDt <= arg_cfl)
+	{
+		return arg_maxDt;
+	}
+	return float(arg_cfl / MAX_CELL_SPEED);
+}
+
+// The speed is re-read after every substep, so a frame that calms down
+// finishes in fewer, larger steps. The remaining time is split evenly to
+// avoid a tiny last step.
+template <typename Solver, typename Advector, typename Boundary, typename Layout, typename Precision, typename Stencil>
+int FluidSimulator<Solver, Advector, Boundary, Layout, Precision, Stencil>::advance(float arg_frameTime, float arg_cfl, int arg_maxSubsteps)
+{
+	float remaining = arg_frameTime;
+	int substeps = 0;
+	while (remaining > 0.0f && substeps < arg_maxSubsteps)
+	{
+		int needed = (int)glm::ceil(remaining / stableTimestep(arg_cfl, remaining));
+		needed = glm::clamp(needed, 1, arg_maxSubsteps - substeps);
+		float dt = remaining / needed;
+		FLUID_CELL->dt = dt;
+		step();
+		remaining = needed == 1 ? 0.0f : remaining - dt;
+		substeps++;
+	}
+	return substeps;
+}
+
+#endif
@@ -0,0 +1,299 @@
+#include "sweep.h"
+#include "simulator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <xmmintrin.h>
+#include <pmmintrin.h>
+
+typedef FluidSimulator<GaussSeidelSolver, BilinearAdvector, BoxBoundary, RowMajorLayout> SweepSimulator;
+
+static const char* SCENARIO_NAMES[] = { "plume", "vortex", "jets" };
+
+template <typename T>
+static bool ParseList(const std::string& arg_value, std::vector<T>& arg_out)
+{
+	std::vector<T> values;
+	std::istringstream items(arg_value);
+	std::string item;
+	while (std::getline(items, item, ','))
+	{
+		std::istringstream parser(item);
+		T value;
+		if (!(parser >> value) || !parser.eof())
+		{
+			return false;
+		}
+		values.push_back(value);
+	}
+	if (values.empty())
+	{
+		return false;
+	}
+	arg_out = values;
+	return true;
+}
+
+// Fails naming the first value below arg_minimum
+template <typename T>
+static bool CheckMinimum(const std::string& arg_key, const std::vector<T>& arg_values, T arg_minimum, std::string* arg_error)
+{
+	for (size_t i = 0; i < arg_values.size(); i++) {
+		if (arg_values[i] < arg_minimum)
+		{
+			if (arg_error)
+			{
+				std::ostringstream message;
+				message << arg_key << "=" << arg_values[i] << " is below the minimum of " << arg_minimum;
+				*arg_error = message.str();
+			}
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool ParseScenarios(const std::string& arg_value, std::vector<ScenarioKind>& arg_out)
+{
+	std::vector<ScenarioKind> values;
+	std::istringstream items(arg_value);
+	std::string item;
+	while (std::getline(items, item, ','))
+	{
+		int kind = 0;
+		while (kind < 3 && item != SCENARIO_NAMES[kind])
+		{
+			kind++;
+		}
+		if (kind == 3)
+		{
+			return false;
+		}
+		values.push_back((ScenarioKind)kind);
+	}
+	if (values.empty())
+	{
+		return false;
+	}
+	arg_out = values;
+	return true;
+}
+
+bool SweepSpec::parse(const std::string& arg_text, std::string* arg_error)
+{
+	std::istringstream tokens(arg_text);
+	std::string token;
+	while (tokens >> token)
+	{
+		size_t split = token.find('=');
+		if (split == std::string::npos)
+		{
+			if (arg_error)
+			{
+				*arg_error = "expected key=value, got " + token;
+			}
+			return false;
+		}
+		std::string key = token.substr(0, split);
+		std::string value = token.substr(split + 1);
+		std::vector<int> single;
+		bool parsed = false;
+		if (key == "diffusion") parsed = ParseList(value, diffusions);
+		else if (key == "viscosity") parsed = ParseList(value, viscocities);
+		else if (key == "dt") parsed = ParseList(value, dts);
+		else if (key == "iterations") parsed = ParseList(value, iterations);
+		else if (key == "resolution") parsed = ParseList(value, resolutions);
+		else if (key == "scenario") parsed = ParseScenarios(value, scenarios);
+		else if (key == "steps" || key == "threads")
+		{
+			parsed = ParseList(value, single) && single.size() == 1;
+			if (parsed)
+			{
+				(key == "steps" ? steps : threads) = single[0];
+			}
+		}
+		if (!parsed)
+		{
+			if (arg_error)
+			{
+				*arg_error = "unknown key or unreadable value in " + token;
+			}
+			return false;
+		}
+	}
+	// the scenarios inject a few cells in from the walls, smaller grids would
+	// put them outside
+	return CheckMinimum("resolution", resolutions, MIN_RESOLUTION, arg_error)
+		&& CheckMinimum("iterations", iterations, 1, arg_error)
+		&& CheckMinimum("steps", std::vector<int>(1, steps), 1, arg_error);
+}
+
+int SweepSpec::runCount() const
+{
+	return (int)(diffusions.size() * viscocities.size() * dts.size() * iterations.size() * resolutions.size() * scenarios.size());
+}
+
+// the cell and simulator a worker reuses while the resolution stays the same
+class SweepWorkspace
+{
+public:
+	FluidCell<RowMajorLayout> cell;
+	SweepSimulator simulator;
+	SweepWorkspace(int arg_resolution)
+		: cell(0.0f, 0.0f, 0.0f, arg_resolution, arg_resolution), simulator(&cell, 1) {}
+};
+
+// Velocities are in domain units per unit time, so the same scenario moves
+// dye the same distance at every resolution
+static void InjectScenario(ScenarioKind arg_scenario, SweepSimulator& arg_sim, int arg_step)
+{
+	const int n = arg_sim.GRID_WIDTH;
+	switch (arg_scenario) {
+	case SCENARIO_PLUME:
+		for (int i = n / 2 - 2; i < n / 2 + 2; i++) {
+			arg_sim.addDye(i, 2, 10.0f);
+			arg_sim.addVelocity(i, 2, 0.0f, 2000.0f);
+		}
+		break;
+	case SCENARIO_VORTEX:
+		if (arg_step == 0)
+		{
+			int radius = n / 6;
+			for (int j = -radius; j <= radius; j++) {
+				for (int i = -radius; i <= radius; i++) {
+					if (i * i + j * j <= radius * radius)
+					{
+						arg_sim.addDye(n / 2 + i, n / 2 + j, 5.0f);
+						arg_sim.addVelocity(n / 2 + i, n / 2 + j, -j * 2000.0f / radius, i * 2000.0f / radius);
+					}
+				}
+			}
+		}
+		break;
+	case SCENARIO_JETS:
+		for (int j = n / 2 - 2; j < n / 2 + 2; j++) {
+			arg_sim.addDye(2, j, 10.0f);
+			arg_sim.addVelocity(2, j, 2000.0f, 0.0f);
+			arg_sim.addDye(n - 3, j, 10.0f);
+			arg_sim.addVelocity(n - 3, j, -2000.0f, 0.0f);
+		}
+		break;
+	}
+}
+
+static void Measure(const SweepWorkspace& arg_workspace, SweepResult& arg_result)
+{
+	const FluidCell<RowMajorLayout>& cell = arg_workspace.cell;
+	const SweepSimulator& sim = arg_workspace.simulator;
+	double density = 0.0;
+	double energy = 0.0;
+	for (int j = 1; j < cell.height - 1; j++) {
+		for (int i = 1; i < cell.width - 1; i++) {
+			int index = sim.GenerateIndex(i, j);
+			float u = cell.velocityX.current[index];
+			float v = cell.velocityY.current[index];
+			density += cell.density.current[index];
+			energy += 0.5 * (u * u + v * v);
+		}
+	}
+	arg_result.totalDensity = (float)density;
+	arg_result.kineticEnergy = (float)(energy * cell.cellSizeX * cell.cellSizeY);
+	arg_result.maxCellSpeed = sim.MAX_CELL_SPEED;
+}
+
+std::vector<SweepResult> RunSweep(const SweepSpec& arg_spec)
+{
+	// resolution outermost, so runs handed out one after another share a grid size
+	std::vector<SweepResult> results;
+	results.reserve(arg_spec.runCount());
+	for (int resolution : arg_spec.resolutions) {
+		for (ScenarioKind scenario : arg_spec.scenarios) {
+			for (int iterations : arg_spec.iterations) {
+				for (float dt : arg_spec.dts) {
+					for (float viscocity : arg_spec.viscocities) {
+						for (float diffusion : arg_spec.diffusions) {
+							SweepResult result = SweepResult();
+							result.diffusion = diffusion;
+							result.viscocity = viscocity;
+							result.dt = dt;
+							result.iterations = iterations;
+							result.resolution = resolution;
+							result.scenario = scenario;
+							results.push_back(result);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	int threads = arg_spec.threads > 0 ? arg_spec.threads : (int)std::thread::hardware_concurrency();
+	threads = std::max(1, std::min(threads, (int)results.size()));
+	std::atomic<int> nextRun(0);
+
+	auto worker = [&]()
+	{
+		// the flush modes live in each thread's MXCSR, restored for the calling thread below
+		unsigned int savedCsr = _mm_getcsr();
+		if (arg_spec.flushDenormals)
+		{
+			_MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+			_MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+		}
+		std::unique_ptr<SweepWorkspace> workspace;
+		for (int run = nextRun++; run < (int)results.size(); run = nextRun++)
+		{
+			SweepResult& result = results[run];
+			if (!workspace || workspace->cell.width != result.resolution)
+			{
+				workspace.reset(new SweepWorkspace(result.resolution));
+			}
+			else
+			{
+				workspace->cell.clear();
+			}
+			FluidCell<RowMajorLayout>& cell = workspace->cell;
+			SweepSimulator& sim = workspace->simulator;
+			cell.diffusion = result.diffusion;
+			cell.viscocity = result.viscocity;
+			cell.dt = result.dt;
+			sim.NUM_ITERATIONS = result.iterations;
+			sim.MAX_CELL_SPEED = 0.0f;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int step = 0; step < arg_spec.steps; step++) {
+				InjectScenario(result.scenario, sim, step);
+				sim.step();
+			}
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			result.msPerStep = arg_spec.steps > 0 ? ms / arg_spec.steps : 0.0;
+			Measure(*workspace, result);
+		}
+		_mm_setcsr(savedCsr);
+	};
+
+	std::vector<std::thread> pool;
+	for (int i = 1; i < threads; i++) {
+		pool.push_back(std::thread(worker));
+	}
+	// the calling thread works too, so a one-thread sweep starts no threads
+	worker();
+	for (std::thread& thread : pool) {
+		thread.join();
+	}
+	return results;
+}
+
+void WriteSweepCsv(const std::vector<SweepResult>& arg_results, std::ostream& arg_out)
+{
+	arg_out << "scenario,resolution,iterations,dt,diffusion,viscosity,total_density,kinetic_energy,max_cell_speed,ms_per_step\n";
+	for (const SweepResult& result : arg_results) {
+		arg_out << SCENARIO_NAMES[result.scenario] << ',' << result.resolution << ',' << result.iterations << ','
+			<< result.dt << ',' << result.diffusion << ',' << result.viscocity << ','
+			<< result.totalDensity << ',' << result.kineticEnergy << ',' << result.maxCellSpeed << ','
+			<< result.msPerStep << '\n';
+	}
+}
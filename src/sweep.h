@@ -0,0 +1,56 @@
+#pragma once
+#ifndef SWEEP_H
+#define SWEEP_H
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum ScenarioKind { SCENARIO_PLUME, SCENARIO_VORTEX, SCENARIO_JETS };
+
+// Every combination of the listed values is one run
+class SweepSpec
+{
+public:
+	static const int MIN_RESOLUTION = 8;
+	std::vector<float> diffusions, viscocities, dts;
+	std::vector<int> iterations;
+	// square grids, in cells along each side
+	std::vector<int> resolutions;
+	std::vector<ScenarioKind> scenarios;
+	int steps;
+	// 0 uses one worker per hardware thread
+	int threads;
+	// run with denormals flushed to zero, much faster once plumes decay
+	bool flushDenormals;
+	SweepSpec()
+		: diffusions(1, 0.2f), viscocities(1, 0.01f), dts(1, 0.000005f), iterations(1, 16), resolutions(1, 64),
+		scenarios(1, SCENARIO_PLUME), steps(200), threads(0), flushDenormals(true) {}
+	// reads space separated key=value,value lists, e.g.
+	// "diffusion=0.1,0.2 viscosity=0.01 resolution=64,128 scenario=plume,vortex steps=100";
+	// keys left out keep their defaults. Returns false on an unknown key or
+	// value, a resolution below MIN_RESOLUTION or fewer than one iteration or
+	// step, and then describes the problem in arg_error if given.
+	bool parse(const std::string& arg_text, std::string* arg_error = nullptr);
+	int runCount() const;
+};
+
+class SweepResult
+{
+public:
+	float diffusion, viscocity, dt;
+	int iterations, resolution;
+	ScenarioKind scenario;
+	// state after the last step
+	float totalDensity, kineticEnergy, maxCellSpeed;
+	double msPerStep;
+};
+
+// Runs every combination of a SweepSpec on a fixed set of worker threads.
+// Runs are ordered with resolution outermost and each worker keeps the
+// FluidCell and simulator of its previous run, so consecutive runs at the
+// same resolution clear and reuse them instead of allocating new ones.
+std::vector<SweepResult> RunSweep(const SweepSpec& arg_spec);
+// one header line, then one line per run
+void WriteSweepCsv(const std::vector<SweepResult>& arg_results, std::ostream& arg_out);
+
+#endif
@@ -0,0 +1,237 @@
+#include "transport.h"
+#include <algorithm>
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+void Transport::exchange(int arg_peer, const void* arg_out, void* arg_in, size_t arg_bytes)
+{
+	if (getRank() < arg_peer)
+	{
+		send(arg_peer, arg_out, arg_bytes);
+		receive(arg_peer, arg_in, arg_bytes);
+	}
+	else
+	{
+		receive(arg_peer, arg_in, arg_bytes);
+		send(arg_peer, arg_out, arg_bytes);
+	}
+}
+
+// reduced up the chain of ranks, then the result is passed back down
+float Transport::allReduceMax(float arg_value)
+{
+	int rank = getRank();
+	float value = arg_value;
+	if (rank > 0)
+	{
+		float lower;
+		receive(rank - 1, &lower, sizeof(lower));
+		value = std::max(value, lower);
+	}
+	if (rank < getSize() - 1)
+	{
+		send(rank + 1, &value, sizeof(value));
+		receive(rank + 1, &value, sizeof(value));
+	}
+	if (rank > 0)
+	{
+		send(rank - 1, &value, sizeof(value));
+	}
+	return value;
+}
+
+#ifndef _WIN32
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+static bool SocketAddress(const std::string& arg_path, int arg_rank, sockaddr_un& arg_address)
+{
+	std::string path = arg_path + "." + std::to_string(arg_rank);
+	if (path.size() >= sizeof(arg_address.sun_path))
+	{
+		return false;
+	}
+	memset(&arg_address, 0, sizeof(arg_address));
+	arg_address.sun_family = AF_UNIX;
+	strcpy(arg_address.sun_path, path.c_str());
+	return true;
+}
+
+UnixSocketTransport::UnixSocketTransport(int arg_rank, int arg_size, int arg_below, int arg_above)
+	: rank(arg_rank), size(arg_size), below(arg_below), above(arg_above)
+{
+}
+
+UnixSocketTransport::~UnixSocketTransport()
+{
+	if (below >= 0)
+	{
+		close(below);
+	}
+	if (above >= 0)
+	{
+		close(above);
+	}
+}
+
+UnixSocketTransport* UnixSocketTransport::Connect(const std::string& arg_path, int arg_rank, int arg_size)
+{
+	int listener = -1;
+	int below = -1;
+	int above = -1;
+	sockaddr_un address;
+
+	// listen before connecting downwards, so rank r + 1 never waits on rank r's own connect
+	if (arg_rank < arg_size - 1)
+	{
+		if (!SocketAddress(arg_path, arg_rank, address))
+		{
+			return nullptr;
+		}
+		unlink(address.sun_path);
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 1) != 0)
+		{
+			if (listener >= 0)
+			{
+				close(listener);
+			}
+			return nullptr;
+		}
+	}
+	if (arg_rank > 0)
+	{
+		if (!SocketAddress(arg_path, arg_rank - 1, address))
+		{
+			return nullptr;
+		}
+		// the rank below may not have started yet
+		for (int attempt = 0; attempt < CONNECT_TIMEOUT_MS / 10 && below < 0; attempt++) {
+			below = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (connect(below, (sockaddr*)&address, sizeof(address)) != 0)
+			{
+				close(below);
+				below = -1;
+				usleep(10000);
+			}
+		}
+	}
+	if (listener >= 0)
+	{
+		if (arg_rank == 0 || below >= 0)
+		{
+			// the rank above may never start, so the wait is bounded too
+			pollfd pending = { listener, POLLIN, 0 };
+			int ready;
+			do
+			{
+				ready = poll(&pending, 1, CONNECT_TIMEOUT_MS);
+			} while (ready < 0 && errno == EINTR);
+			if (ready > 0)
+			{
+				above = accept(listener, nullptr, nullptr);
+			}
+		}
+		SocketAddress(arg_path, arg_rank, address);
+		unlink(address.sun_path);
+		close(listener);
+	}
+	if ((arg_rank > 0 && below < 0) || (arg_rank < arg_size - 1 && above < 0))
+	{
+		if (below >= 0)
+		{
+			close(below);
+		}
+		if (above >= 0)
+		{
+			close(above);
+		}
+		return nullptr;
+	}
+	return new UnixSocketTransport(arg_rank, arg_size, below, above);
+}
+
+// -1 for a rank that is not a neighbour
+int UnixSocketTransport::socketFor(int arg_peer) const
+{
+	return arg_peer == rank - 1 ? below : arg_peer == rank + 1 ? above : -1;
+}
+
+void UnixSocketTransport::fail()
+{
+	failed = true;
+	if (below >= 0)
+	{
+		shutdown(below, SHUT_RDWR);
+	}
+	if (above >= 0)
+	{
+		shutdown(above, SHUT_RDWR);
+	}
+}
+
+void UnixSocketTransport::send(int arg_peer, const void* arg_data, size_t arg_bytes)
+{
+	int socket = socketFor(arg_peer);
+	if (socket < 0)
+	{
+		fail();
+	}
+	const char* data = (const char*)arg_data;
+	while (!failed && arg_bytes > 0)
+	{
+		ssize_t sent = ::send(socket, data, arg_bytes, SEND_FLAGS);
+		if (sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (sent <= 0)
+		{
+			fail();
+			break;
+		}
+		data += sent;
+		arg_bytes -= sent;
+	}
+}
+
+void UnixSocketTransport::receive(int arg_peer, void* arg_data, size_t arg_bytes)
+{
+	int socket = socketFor(arg_peer);
+	if (socket < 0)
+	{
+		fail();
+	}
+	char* data = (char*)arg_data;
+	while (!failed && arg_bytes > 0)
+	{
+		ssize_t received = recv(socket, data, arg_bytes, 0);
+		if (received < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (received <= 0)
+		{
+			fail();
+			break;
+		}
+		data += received;
+		arg_bytes -= received;
+	}
+	if (failed)
+	{
+		memset(data, 0, arg_bytes);
+	}
+}
+
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+#include <cstddef>
+#include <string>
+
+// Blocking byte transport between the ranks of a DistributedSimulator. Only
+// neighbouring ranks talk to each other. Once a transfer fails the transport
+// stays failed: every later transfer returns at once, receiving zeros, so a
+// step in progress runs to its end and the caller checks hasFailed().
+class Transport
+{
+public:
+	Transport() : failed(false) {}
+	virtual ~Transport() {}
+	virtual int getRank() const = 0;
+	virtual int getSize() const = 0;
+	virtual void send(int arg_peer, const void* arg_data, size_t arg_bytes) = 0;
+	virtual void receive(int arg_peer, void* arg_data, size_t arg_bytes) = 0;
+	// swaps arg_bytes with arg_peer; the lower rank sends first, so the two
+	// ends never both wait on full buffers
+	void exchange(int arg_peer, const void* arg_out, void* arg_in, size_t arg_bytes);
+	// largest arg_value over all ranks, returned on every rank
+	float allReduceMax(float arg_value);
+	bool hasFailed() const { return failed; }
+
+protected:
+	bool failed;
+};
+
+#ifndef _WIN32
+// Unix domain stream sockets between neighbouring processes on one machine.
+// Rank r listens on "<path>.<r>" for rank r + 1 and connects to rank r - 1,
+// so the ranks can be started in any order.
+class UnixSocketTransport : public Transport
+{
+public:
+	static const int CONNECT_TIMEOUT_MS = 5000;
+	// returns nullptr if the connections cannot be set up within CONNECT_TIMEOUT_MS
+	static UnixSocketTransport* Connect(const std::string& arg_path, int arg_rank, int arg_size);
+	UnixSocketTransport(const UnixSocketTransport&) = delete;
+	UnixSocketTransport& operator=(const UnixSocketTransport&) = delete;
+	~UnixSocketTransport();
+	int getRank() const override { return rank; }
+	int getSize() const override { return size; }
+	void send(int arg_peer, const void* arg_data, size_t arg_bytes) override;
+	void receive(int arg_peer, void* arg_data, size_t arg_bytes) override;
+
+private:
+	int rank, size;
+	// connected sockets, -1 at the ends of the chain
+	int below, above;
+	UnixSocketTransport(int arg_rank, int arg_size, int arg_below, int arg_above);
+	int socketFor(int arg_peer) const;
+	// marks the transport failed and shuts both connections, so the
+	// neighbours' transfers fail too instead of waiting on this rank
+	void fail();
+};
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+#include "upload_ring.h"
+#include <cstddef>
+
+#define BUFFER_OFFSET( offset )   ((GLvoid*) (offset))
+
+UploadRing* UploadRing::Create(UploadMode arg_mode, GLsizeiptr arg_regionBytes, int arg_regions)
+{
+	if (arg_mode == UPLOAD_DIRECT || arg_regionBytes < 1 || arg_regions < 1)
+	{
+		return nullptr;
+	}
+	if (arg_mode == UPLOAD_PERSISTENT && !(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage))
+	{
+		return nullptr;
+	}
+	// regions start on 256-byte boundaries, which suits every texel type
+	GLsizeiptr regionBytes = (arg_regionBytes + 255) & ~(GLsizeiptr)255;
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	UploadRing* ring = new UploadRing(arg_mode, buffer, regionBytes, arg_mode == UPLOAD_PERSISTENT ? arg_regions : 1);
+	if (arg_mode == UPLOAD_PERSISTENT)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLsizeiptr totalBytes = regionBytes * arg_regions;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, totalBytes, NULL, flags);
+		ring->base = (char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, totalBytes, flags);
+	}
+	else
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, regionBytes, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (arg_mode == UPLOAD_PERSISTENT && !ring->base)
+	{
+		delete ring;
+		return nullptr;
+	}
+	return ring;
+}
+
+UploadRing::~UploadRing()
+{
+	for (GLsync fence : fences) {
+		if (fence)
+		{
+			glDeleteSync(fence);
+		}
+	}
+	if (base)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+void* UploadRing::map()
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	if (mode == UPLOAD_PERSISTENT)
+	{
+		GLsync& fence = fences[current];
+		if (fence)
+		{
+			// only waits if every region is still queued for the GPU
+			GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			while (status == GL_TIMEOUT_EXPIRED)
+			{
+				status = glClientWaitSync(fence, 0, 1000000000);
+			}
+			glDeleteSync(fence);
+			fence = (GLsync)0;
+		}
+		return base + current * regionBytes;
+	}
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, regionBytes, NULL, GL_STREAM_DRAW);
+	void* region = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, regionBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (!region)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	return region;
+}
+
+const GLvoid* UploadRing::unmap()
+{
+	if (mode == UPLOAD_PERSISTENT)
+	{
+		// coherent, the writes need no flush
+		return BUFFER_OFFSET(current * regionBytes);
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	return BUFFER_OFFSET(0);
+}
+
+void UploadRing::retire()
+{
+	if (mode == UPLOAD_PERSISTENT)
+	{
+		fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		current = (current + 1) % (int)fences.size();
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef UPLOAD_RING_H
+#define UPLOAD_RING_H
+#include <GL/glew.h>
+#include <vector>
+
+// From slowest to fastest; UploadRing::Create() falls back down this list
+enum UploadMode { UPLOAD_DIRECT, UPLOAD_ORPHAN, UPLOAD_PERSISTENT };
+
+// Streams per-frame texture data through a GL_PIXEL_UNPACK_BUFFER, so
+// callers fill driver memory directly instead of handing over a pointer for
+// the driver to copy from.
+// UPLOAD_PERSISTENT (GL 4.4 or ARB_buffer_storage) maps the buffer once,
+// coherently, and splits it into regions used in turn. A fence per region
+// makes the CPU wait only if it laps the GPU.
+// UPLOAD_ORPHAN re-specifies the buffer every frame before mapping it, so
+// the driver hands out fresh storage instead of waiting for the previous
+// frame's upload to be consumed.
+class UploadRing
+{
+public:
+	// returns nullptr for UPLOAD_DIRECT, or if the mode is not supported
+	static UploadRing* Create(UploadMode arg_mode, GLsizeiptr arg_regionBytes, int arg_regions);
+	UploadRing(const UploadRing&) = delete;
+	UploadRing& operator=(const UploadRing&) = delete;
+	~UploadRing();
+	UploadMode getMode() const { return mode; }
+	// binds the buffer and returns the next region to write, nullptr (and unbound) if mapping failed
+	void* map();
+	// ends the writes, returns what to pass as the pixel pointer of glTexSubImage2D
+	const GLvoid* unmap();
+	// after the texture calls reading the region: fences it and unbinds the buffer
+	void retire();
+
+private:
+	UploadMode mode;
+	GLuint buffer;
+	GLsizeiptr regionBytes;
+	// persistent mapping only
+	char* base;
+	std::vector<GLsync> fences;
+	int current;
+
+	UploadRing(UploadMode arg_mode, GLuint arg_buffer, GLsizeiptr arg_regionBytes, int arg_regions)
+		: mode(arg_mode), buffer(arg_buffer), regionBytes(arg_regionBytes), base(nullptr), fences(arg_regions, (GLsync)0), current(0) {}
+};
+
+#endif
@@ -2,10 +2,10 @@
 
 in vec4 vPosition;
 
-out float alphaVal;
+out vec2 texCoord;
 
 void main()
 {
-  alphaVal = vPosition.z;
+  texCoord = vPosition.xy * 0.5 + 0.5;
   gl_Position = vPosition;
 }
\ No newline at end of file